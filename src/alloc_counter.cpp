@@ -0,0 +1,100 @@
+#include "alloc_counter.hpp"
+
+#ifdef TRINKSTER_ALLOC_COUNTER
+
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+namespace
+{
+std::atomic<uint64_t> allocations;
+std::atomic<uint64_t> deallocations;
+std::atomic<uint64_t> bytes;
+
+void* counted_alloc(std::size_t size, std::size_t alignment)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    bytes.fetch_add(size, std::memory_order_relaxed);
+
+    if (size == 0)
+    {
+        size = 1;
+    }
+
+    void* p = nullptr;
+    if (alignment <= alignof(std::max_align_t))
+    {
+        p = std::malloc(size);
+    }
+    else if (posix_memalign(&p, alignment, size) != 0)
+    {
+        p = nullptr;
+    }
+
+    if (!p)
+    {
+        throw std::bad_alloc{};
+    }
+
+    return p;
+}
+
+void counted_free(void* p)
+{
+    if (p)
+    {
+        deallocations.fetch_add(1, std::memory_order_relaxed);
+        std::free(p);
+    }
+}
+} // namespace
+
+// the array and nothrow forms of the standard library forward to these
+
+void* operator new(std::size_t size)
+{
+    return counted_alloc(size, alignof(std::max_align_t));
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment)
+{
+    return counted_alloc(size, static_cast<std::size_t>(alignment));
+}
+
+void operator delete(void* p) noexcept
+{
+    counted_free(p);
+}
+
+void operator delete(void* p, std::align_val_t) noexcept
+{
+    counted_free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+    counted_free(p);
+}
+
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept
+{
+    counted_free(p);
+}
+
+alloc_stats allocation_stats()
+{
+    return {allocations.load(std::memory_order_relaxed),
+            deallocations.load(std::memory_order_relaxed),
+            bytes.load(std::memory_order_relaxed)};
+}
+
+#else
+
+alloc_stats allocation_stats()
+{
+    return {};
+}
+
+#endif
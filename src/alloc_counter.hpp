@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstdint>
+
+/// global operator new and delete traffic since startup
+struct alloc_stats
+{
+    uint64_t allocations;
+    uint64_t deallocations;
+    uint64_t bytes;
+};
+
+/// whether this build replaces operator new to count, see the
+/// alloc_counter build option. malloc from C libraries is never seen.
+#ifdef TRINKSTER_ALLOC_COUNTER
+constexpr bool alloc_counting = true;
+#else
+constexpr bool alloc_counting = false;
+#endif
+
+/// zeroes unless alloc_counting
+alloc_stats allocation_stats();
@@ -0,0 +1,26 @@
+#include "arena.hpp"
+
+void* scratch_arena::spill_resource::do_allocate(std::size_t bytes,
+                                                 std::size_t alignment)
+{
+    ++spills;
+    return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+}
+
+void scratch_arena::spill_resource::do_deallocate(void*       p,
+                                                  std::size_t bytes,
+                                                  std::size_t alignment)
+{
+    std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+}
+
+bool scratch_arena::spill_resource::do_is_equal(
+    const std::pmr::memory_resource& other) const noexcept
+{
+    return this == &other;
+}
+
+scratch_arena::scratch_arena(std::size_t size)
+    : buffer_{std::make_unique<std::byte[]>(size)},
+      resource_{buffer_.get(), size, &upstream_}
+{}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+
+/// scratch memory for temporaries that don't outlive an event loop
+/// iteration. allocations come out of a fixed buffer and are all released
+/// at once by reset(), whatever doesn't fit spills to the heap and is
+/// counted so an undersized arena shows up in the stats.
+class scratch_arena
+{
+private:
+    class spill_resource : public std::pmr::memory_resource
+    {
+    public:
+        uint64_t spills = 0;
+
+    private:
+        void* do_allocate(std::size_t bytes, std::size_t alignment) override;
+        void  do_deallocate(void*       p,
+                            std::size_t bytes,
+                            std::size_t alignment) override;
+        bool  do_is_equal(
+             const std::pmr::memory_resource& other) const noexcept override;
+    };
+
+    std::unique_ptr<std::byte[]>        buffer_;
+    spill_resource                      upstream_;
+    std::pmr::monotonic_buffer_resource resource_;
+
+public:
+    explicit scratch_arena(std::size_t size);
+
+    scratch_arena(const scratch_arena&) = delete;
+    scratch_arena& operator=(const scratch_arena&) = delete;
+
+    std::pmr::memory_resource* resource() noexcept
+    {
+        return &resource_;
+    }
+
+    /// hand the whole buffer out again, nothing allocated from it may be
+    /// used afterwards
+    void reset()
+    {
+        resource_.release();
+    }
+
+    /// allocations that didn't fit the buffer since startup
+    uint64_t spills() const noexcept
+    {
+        return upstream_.spills;
+    }
+};
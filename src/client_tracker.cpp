@@ -0,0 +1,393 @@
+#include "client_tracker.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <ctime>
+
+#include "output.hpp"
+#include "server.hpp"
+
+namespace
+{
+uint64_t now_ns()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+uint64_t env_or(const char* name, uint64_t fallback)
+{
+    const char* env = std::getenv(name);
+
+    return env ? std::strtoull(env, nullptr, 10) : fallback;
+}
+} // namespace
+
+client_tracker::surface_entry::surface_entry(client_tracker* tracker,
+                                             client_usage*   usage,
+                                             wlr_surface*    surface)
+    : tracker{tracker}, usage{usage}, surface{surface}, shm_bytes{0},
+      has_buffer{false}, commit{[](auto* listener, void*) {
+          surface_entry* self = wl_container_of(listener, self, commit);
+          self->tracker->handle_commit(*self);
+      }},
+      destroy{[](auto* listener, void*) {
+          surface_entry* self = wl_container_of(listener, self, destroy);
+          self->tracker->remove_surface(*self);
+      }}
+{}
+
+client_tracker::client_entry::client_entry(client_tracker* tracker,
+                                           wl_client*      client)
+    : tracker{tracker}, usage{}, destroy{[](auto* listener, void*) {
+          client_entry* self = wl_container_of(listener, self, destroy);
+
+          // resources outlive the destroy signal, let go of them first
+          for (auto&& surf : self->surfaces)
+          {
+              surf->commit.remove();
+              surf->destroy.remove();
+          }
+
+          if (self->tracker->dispatching_ == &self->usage)
+          {
+              self->tracker->dispatching_ = nullptr;
+          }
+
+          self->tracker->clients_.erase(self->usage.client);
+      }},
+      frame_timer{nullptr}
+{
+    usage.client          = client;
+    usage.window_start_ns = now_ns();
+
+    uid_t uid;
+    gid_t gid;
+    wl_client_get_credentials(client, &usage.pid, &uid, &gid);
+}
+
+client_tracker::client_entry::~client_entry()
+{
+    if (frame_timer)
+    {
+        wl_event_source_remove(frame_timer);
+    }
+}
+
+client_tracker::client_tracker(server*         serv,
+                               wl_display*     display,
+                               wlr_compositor* compositor,
+                               client_policy   policy)
+    : server_{serv}, loop_{wl_display_get_event_loop(display)},
+      policy_{policy}, client_created_{[](auto* listener,
+                                                         void* data) {
+          client_tracker* self =
+              wl_container_of(listener, self, client_created_);
+          auto* client = static_cast<wl_client*>(data);
+
+          auto entry = std::make_unique<client_entry>(self, client);
+          wl_client_add_destroy_listener(client, &entry->destroy);
+          self->clients_.emplace(client, std::move(entry));
+      }},
+      new_surface_{[](auto* listener, void* data) {
+          client_tracker* self = wl_container_of(listener, self, new_surface_);
+          auto* surface        = static_cast<wlr_surface*>(data);
+          auto* usage = self->usage(wl_resource_get_client(surface->resource));
+
+          if (!usage)
+          {
+              return;
+          }
+
+          auto& client = *self->clients_[usage->client];
+          auto  entry =
+              std::make_unique<surface_entry>(self, usage, surface);
+
+          wl::connect(surface->events.commit, entry->commit);
+          wl::connect(surface->events.destroy, entry->destroy);
+          client.surfaces.push_back(std::move(entry));
+
+          ++usage->surfaces;
+          self->update_throttle(*usage);
+      }},
+      window_timer_{nullptr}, request_logger_{nullptr}, dispatching_{nullptr},
+      dispatch_start_ns_{0}, dispatch_idle_{nullptr}
+{
+    wl_display_add_client_created_listener(display, &client_created_);
+    wl::connect(compositor->events.new_surface, new_surface_);
+
+    // rates are rolled on a timer, a client that stops committing has to
+    // come out of the throttle as well
+    window_timer_ = wl_event_loop_add_timer(
+        loop_,
+        [](void* data) {
+            auto* self = static_cast<client_tracker*>(data);
+            self->roll_windows();
+            wl_event_source_timer_update(self->window_timer_, 1000);
+            return 0;
+        },
+        this);
+
+    if (window_timer_)
+    {
+        wl_event_source_timer_update(window_timer_, 1000);
+    }
+
+    request_logger_ =
+        wl_display_add_protocol_logger(display, handle_request, this);
+}
+
+client_tracker::~client_tracker()
+{
+    for (auto&& [client, entry] : clients_)
+    {
+        (void) client;
+
+        for (auto&& surf : entry->surfaces)
+        {
+            surf->commit.remove();
+            surf->destroy.remove();
+        }
+
+        entry->destroy.remove();
+    }
+
+    if (window_timer_)
+    {
+        wl_event_source_remove(window_timer_);
+    }
+
+    if (dispatch_idle_)
+    {
+        wl_event_source_remove(dispatch_idle_);
+    }
+
+    if (request_logger_)
+    {
+        wl_protocol_logger_destroy(request_logger_);
+    }
+
+    client_created_.remove();
+    new_surface_.remove();
+}
+
+client_policy client_tracker::policy_from_env()
+{
+    client_policy policy;
+
+    policy.max_commits_per_sec = static_cast<uint32_t>(
+        env_or("TRINKSTER_CLIENT_MAX_COMMITS", 1000));
+    policy.max_surfaces =
+        static_cast<uint32_t>(env_or("TRINKSTER_CLIENT_MAX_SURFACES", 4096));
+    policy.max_shm_bytes =
+        env_or("TRINKSTER_CLIENT_MAX_SHM_MB", 1024) * 1024 * 1024;
+    policy.throttled_hz =
+        static_cast<uint32_t>(env_or("TRINKSTER_CLIENT_THROTTLED_HZ", 15));
+
+    return policy;
+}
+
+client_usage* client_tracker::usage(wl_client* client)
+{
+    auto it = clients_.find(client);
+
+    return it != std::end(clients_) ? &it->second->usage : nullptr;
+}
+
+bool client_tracker::frame_allowed(client_usage* usage, uint64_t now_ns)
+{
+    if (!usage || !usage->throttled || policy_.throttled_hz == 0)
+    {
+        return true;
+    }
+
+    uint64_t interval = 1000000000 / policy_.throttled_hz;
+
+    if (usage->last_frame_ns == now_ns ||
+        now_ns - usage->last_frame_ns >= interval)
+    {
+        usage->last_frame_ns = now_ns;
+        return true;
+    }
+
+    // nothing else may repaint before the interval is up, make sure the
+    // client isn't left waiting on its callback
+    arm_frame_timer(*usage, interval - (now_ns - usage->last_frame_ns));
+
+    return false;
+}
+
+void client_tracker::settle(uint64_t now_ns)
+{
+    if (dispatching_)
+    {
+        dispatching_->busy_ns += now_ns - dispatch_start_ns_;
+        dispatching_ = nullptr;
+    }
+}
+
+void client_tracker::handle_commit(surface_entry& entry)
+{
+    auto& usage   = *entry.usage;
+    auto* surface = entry.surface;
+
+    ++usage.commits;
+    ++usage.window_commits;
+
+    auto* buffer     = surface->current.buffer_resource;
+    bool  has_buffer = buffer != nullptr;
+
+    uint64_t bytes = 0;
+    if (buffer)
+    {
+        if (auto* shm = wl_shm_buffer_get(buffer))
+        {
+            bytes = static_cast<uint64_t>(wl_shm_buffer_get_stride(shm)) *
+                    wl_shm_buffer_get_height(shm);
+        }
+    }
+
+    usage.buffers   = usage.buffers - entry.has_buffer + has_buffer;
+    usage.shm_bytes = usage.shm_bytes - entry.shm_bytes + bytes;
+
+    entry.has_buffer = has_buffer;
+    entry.shm_bytes  = bytes;
+}
+
+void client_tracker::remove_surface(surface_entry& entry)
+{
+    auto& usage = *entry.usage;
+
+    --usage.surfaces;
+    usage.buffers -= entry.has_buffer;
+    usage.shm_bytes -= entry.shm_bytes;
+
+    entry.commit.remove();
+    entry.destroy.remove();
+
+    auto& surfaces = clients_[usage.client]->surfaces;
+    surfaces.erase(std::find_if(std::begin(surfaces),
+                                std::end(surfaces),
+                                [&](auto&& s) { return s.get() == &entry; }));
+
+    update_throttle(usage);
+}
+
+void client_tracker::update_throttle(client_usage& usage)
+{
+    auto& p    = policy_;
+    bool  over = (p.max_commits_per_sec &&
+                 usage.commits_per_sec > p.max_commits_per_sec) ||
+                (p.max_surfaces && usage.surfaces > p.max_surfaces) ||
+                (p.max_shm_bytes && usage.shm_bytes > p.max_shm_bytes);
+
+    if (over != usage.throttled)
+    {
+        usage.throttled = over;
+
+        wlr_log(WLR_INFO,
+                "pid %ld %s: %u commits/s, %u surfaces, %lu shm bytes",
+                static_cast<long>(usage.pid),
+                over ? "over budget, throttling frame callbacks"
+                     : "back within budget",
+                usage.commits_per_sec,
+                usage.surfaces,
+                static_cast<unsigned long>(usage.shm_bytes));
+    }
+}
+
+void client_tracker::roll_windows()
+{
+    auto now = now_ns();
+
+    for (auto&& [client, entry] : clients_)
+    {
+        (void) client;
+
+        auto& usage   = entry->usage;
+        auto  elapsed = now - usage.window_start_ns;
+
+        if (elapsed == 0)
+        {
+            continue;
+        }
+
+        usage.commits_per_sec = static_cast<uint32_t>(
+            uint64_t{usage.window_commits} * 1000000000 / elapsed);
+        usage.window_commits  = 0;
+        usage.window_start_ns = now;
+
+        update_throttle(usage);
+    }
+}
+
+void client_tracker::arm_frame_timer(client_usage& usage, uint64_t delay_ns)
+{
+    auto it = clients_.find(usage.client);
+    if (it == std::end(clients_))
+    {
+        return;
+    }
+
+    auto& entry = *it->second;
+
+    if (!entry.frame_timer)
+    {
+        entry.frame_timer = wl_event_loop_add_timer(
+            loop_,
+            [](void* data) {
+                auto* entry = static_cast<client_entry*>(data);
+
+                for (auto* out : entry->tracker->server_->outputs())
+                {
+                    wlr_output_schedule_frame(out->handle());
+                }
+
+                return 0;
+            },
+            &entry);
+
+        if (!entry.frame_timer)
+        {
+            return;
+        }
+    }
+
+    auto ms = static_cast<int>((delay_ns + 999999) / 1000000);
+    wl_event_source_timer_update(entry.frame_timer, std::max(ms, 1));
+}
+
+void client_tracker::handle_request(void*                             data,
+                                    wl_protocol_logger_type           direction,
+                                    const wl_protocol_logger_message* message)
+{
+    if (direction != WL_PROTOCOL_LOGGER_REQUEST)
+    {
+        return;
+    }
+
+    // libwayland calls in right before it dispatches each request, so a
+    // request runs until the next one or until the compositor settles
+    auto* self = static_cast<client_tracker*>(data);
+    auto  now  = now_ns();
+
+    self->settle(now);
+    self->dispatching_ =
+        self->usage(wl_resource_get_client(message->resource));
+    self->dispatch_start_ns_ = now;
+
+    if (self->dispatching_ && !self->dispatch_idle_)
+    {
+        // idle sources run once the fd sources of this dispatch are done
+        self->dispatch_idle_ = wl_event_loop_add_idle(
+            self->loop_,
+            [](void* data) {
+                auto* self           = static_cast<client_tracker*>(data);
+                self->dispatch_idle_ = nullptr;
+                self->settle(now_ns());
+            },
+            self);
+    }
+}
@@ -0,0 +1,147 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include <sys/types.h>
+
+#include "wl/listener.hpp"
+#include "wlr.hpp"
+
+class server;
+class client_tracker;
+
+/// resources and compositor time used by a single wl_client
+struct client_usage
+{
+    wl_client* client;
+    pid_t      pid;
+
+    uint32_t surfaces;
+    uint32_t buffers;
+    uint64_t shm_bytes;
+
+    uint64_t commits;
+    uint32_t commits_per_sec;
+    uint32_t window_commits;
+    uint64_t window_start_ns;
+
+    // cpu time spent dispatching this client's requests and rendering its
+    // surfaces
+    uint64_t busy_ns;
+
+    bool     throttled;
+    uint64_t last_frame_ns;
+};
+
+/// limits a client may use before its frame callbacks get throttled,
+/// 0 means unlimited
+struct client_policy
+{
+    uint32_t max_commits_per_sec;
+    uint32_t max_surfaces;
+    uint64_t max_shm_bytes;
+
+    // frame callback rate for clients over budget
+    uint32_t throttled_hz;
+};
+
+class client_tracker
+{
+private:
+    struct surface_entry
+    {
+        client_tracker* tracker;
+        client_usage*   usage;
+        wlr_surface*    surface;
+        uint64_t        shm_bytes;
+        bool            has_buffer;
+        wl::listener    commit;
+        wl::listener    destroy;
+
+        surface_entry(client_tracker* tracker,
+                      client_usage*   usage,
+                      wlr_surface*    surface);
+    };
+
+    struct client_entry
+    {
+        client_tracker*                             tracker;
+        client_usage                                usage;
+        std::vector<std::unique_ptr<surface_entry>> surfaces;
+        wl::listener                                destroy;
+
+        // wakes the outputs once a throttled client is owed a frame again
+        wl_event_source* frame_timer;
+
+        client_entry(client_tracker* tracker, wl_client* client);
+        ~client_entry();
+    };
+
+    server*             server_;
+    wl_event_loop*      loop_;
+    client_policy       policy_;
+    wl::listener        client_created_;
+    wl::listener        new_surface_;
+    wl_event_source*    window_timer_;
+    wl_protocol_logger* request_logger_;
+
+    // the client whose request is being dispatched right now
+    client_usage*    dispatching_;
+    uint64_t         dispatch_start_ns_;
+    wl_event_source* dispatch_idle_;
+
+    std::unordered_map<wl_client*, std::unique_ptr<client_entry>> clients_;
+
+public:
+    client_tracker(server*         serv,
+                   wl_display*     display,
+                   wlr_compositor* compositor,
+                   client_policy   policy);
+    ~client_tracker();
+
+    client_tracker(const client_tracker&) = delete;
+    client_tracker& operator=(const client_tracker&) = delete;
+
+    /// policy from TRINKSTER_CLIENT_* environment variables
+    static client_policy policy_from_env();
+
+    const client_policy& policy() const
+    {
+        return policy_;
+    }
+
+    client_usage* usage(wl_client* client);
+
+    template<typename F>
+    void for_each(F&& fn)
+    {
+        for (auto&& [client, entry] : clients_)
+        {
+            (void) client;
+            fn(entry->usage);
+        }
+    }
+
+    /// whether a frame callback may go out to this client now, throttled
+    /// clients only get them at the policy's reduced rate.
+    /// calls for the same frame share a timestamp and get the same answer.
+    bool frame_allowed(client_usage* usage, uint64_t now_ns);
+
+    /// charge the request being dispatched to its client, called whenever
+    /// the compositor turns to something else.
+    void settle(uint64_t now_ns);
+
+private:
+    void handle_commit(surface_entry& entry);
+    void remove_surface(surface_entry& entry);
+    void update_throttle(client_usage& usage);
+    void roll_windows();
+    void arm_frame_timer(client_usage& usage, uint64_t delay_ns);
+
+    static void handle_request(void*                             data,
+                               wl_protocol_logger_type           direction,
+                               const wl_protocol_logger_message* message);
+};
@@ -0,0 +1,93 @@
+#include "decoration.hpp"
+
+#include "server.hpp"
+#include "view.hpp"
+
+decoration_manager::toplevel_decoration::toplevel_decoration(
+    decoration_manager*             manager,
+    wlr_xdg_toplevel_decoration_v1* handle)
+    : manager{manager}, handle{handle},
+      request_mode{[](auto* listener, void*) {
+          toplevel_decoration* self =
+              wl_container_of(listener, self, request_mode);
+          self->manager->set_mode(*self);
+      }},
+      destroy{[](auto* listener, void*) {
+          toplevel_decoration* self = wl_container_of(listener, self, destroy);
+
+          auto* manager = self->manager;
+          auto* surface = self->handle->surface;
+
+          self->request_mode.remove();
+          self->destroy.remove();
+          manager->decorations_.erase(surface);
+          manager->notify(surface);
+      }}
+{}
+
+decoration_manager::decoration_manager(server* serv, wl_display* display)
+    : server_{serv}, manager_{wlr_xdg_decoration_manager_v1_create(display)},
+      new_decoration_{[](auto* listener, void* data) {
+          decoration_manager* self =
+              wl_container_of(listener, self, new_decoration_);
+          auto* handle = static_cast<wlr_xdg_toplevel_decoration_v1*>(data);
+
+          auto deco = std::make_unique<toplevel_decoration>(self, handle);
+
+          wl::connect(handle->events.request_mode, deco->request_mode);
+          wl::connect(handle->events.destroy, deco->destroy);
+
+          auto& entry = *deco;
+          self->decorations_[handle->surface] = std::move(deco);
+          self->set_mode(entry);
+      }}
+{
+    wl::connect(manager_->events.new_toplevel_decoration, new_decoration_);
+}
+
+decoration_manager::~decoration_manager()
+{
+    for (auto&& [surface, deco] : decorations_)
+    {
+        (void) surface;
+        deco->request_mode.remove();
+        deco->destroy.remove();
+    }
+
+    new_decoration_.remove();
+}
+
+bool decoration_manager::server_side(wlr_xdg_surface* surface) const
+{
+    if (decorations_.empty())
+    {
+        return false;
+    }
+
+    auto it = decorations_.find(surface);
+
+    return it != decorations_.end() &&
+           it->second->handle->server_pending_mode ==
+               WLR_XDG_TOPLEVEL_DECORATION_V1_MODE_SERVER_SIDE;
+}
+
+void decoration_manager::set_mode(toplevel_decoration& deco)
+{
+    auto mode = deco.handle->client_pending_mode;
+
+    if (mode == WLR_XDG_TOPLEVEL_DECORATION_V1_MODE_NONE)
+    {
+        mode = WLR_XDG_TOPLEVEL_DECORATION_V1_MODE_SERVER_SIDE;
+    }
+
+    wlr_xdg_toplevel_decoration_v1_set_mode(deco.handle, mode);
+    notify(deco.handle->surface);
+}
+
+void decoration_manager::notify(wlr_xdg_surface* surface)
+{
+    if (auto* v = server_->view_for(surface))
+    {
+        v->refresh_decoration();
+    }
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <memory>
+#include <unordered_map>
+
+#include "decoration_atlas.hpp"
+#include "wl/listener.hpp"
+#include "wlr.hpp"
+
+class server;
+
+/// negotiates decoration modes over xdg-decoration, server side unless a
+/// client asks otherwise.
+class decoration_manager
+{
+private:
+    struct toplevel_decoration
+    {
+        decoration_manager*              manager;
+        wlr_xdg_toplevel_decoration_v1*  handle;
+        wl::listener                     request_mode;
+        wl::listener                     destroy;
+
+        toplevel_decoration(decoration_manager*             manager,
+                            wlr_xdg_toplevel_decoration_v1* handle);
+    };
+
+    server*                        server_;
+    wlr_xdg_decoration_manager_v1* manager_;
+    wl::listener                   new_decoration_;
+
+    std::unordered_map<wlr_xdg_surface*,
+                       std::unique_ptr<toplevel_decoration>>
+        decorations_;
+
+public:
+    decoration_manager(server* serv, wl_display* display);
+    ~decoration_manager();
+
+    decoration_manager(const decoration_manager&) = delete;
+    decoration_manager& operator=(const decoration_manager&) = delete;
+
+    /// whether we draw the decorations of this toplevel
+    bool server_side(wlr_xdg_surface* surface) const;
+
+private:
+    void set_mode(toplevel_decoration& deco);
+    void notify(wlr_xdg_surface* surface);
+};
@@ -0,0 +1,387 @@
+#include "decoration_atlas.hpp"
+
+#include <algorithm>
+
+#include "render_plan.hpp"
+
+namespace
+{
+constexpr char first_glyph = ' ';
+constexpr char last_glyph  = '~';
+constexpr int  glyph_count = last_glyph - first_glyph + 1;
+
+// 5x7 font, one byte per column with the top row in the lowest bit
+constexpr uint8_t font[glyph_count][5] = {
+    {0x00, 0x00, 0x00, 0x00, 0x00}, {0x00, 0x00, 0x5f, 0x00, 0x00},
+    {0x00, 0x07, 0x00, 0x07, 0x00}, {0x14, 0x7f, 0x14, 0x7f, 0x14},
+    {0x24, 0x2a, 0x7f, 0x2a, 0x12}, {0x23, 0x13, 0x08, 0x64, 0x62},
+    {0x36, 0x49, 0x55, 0x22, 0x50}, {0x00, 0x05, 0x03, 0x00, 0x00},
+    {0x00, 0x1c, 0x22, 0x41, 0x00}, {0x00, 0x41, 0x22, 0x1c, 0x00},
+    {0x08, 0x2a, 0x1c, 0x2a, 0x08}, {0x08, 0x08, 0x3e, 0x08, 0x08},
+    {0x00, 0x50, 0x30, 0x00, 0x00}, {0x08, 0x08, 0x08, 0x08, 0x08},
+    {0x00, 0x60, 0x60, 0x00, 0x00}, {0x20, 0x10, 0x08, 0x04, 0x02},
+    {0x3e, 0x51, 0x49, 0x45, 0x3e}, {0x00, 0x42, 0x7f, 0x40, 0x00},
+    {0x42, 0x61, 0x51, 0x49, 0x46}, {0x21, 0x41, 0x45, 0x4b, 0x31},
+    {0x18, 0x14, 0x12, 0x7f, 0x10}, {0x27, 0x45, 0x45, 0x45, 0x39},
+    {0x3c, 0x4a, 0x49, 0x49, 0x30}, {0x01, 0x71, 0x09, 0x05, 0x03},
+    {0x36, 0x49, 0x49, 0x49, 0x36}, {0x06, 0x49, 0x49, 0x29, 0x1e},
+    {0x00, 0x36, 0x36, 0x00, 0x00}, {0x00, 0x56, 0x36, 0x00, 0x00},
+    {0x08, 0x14, 0x22, 0x41, 0x00}, {0x14, 0x14, 0x14, 0x14, 0x14},
+    {0x00, 0x41, 0x22, 0x14, 0x08}, {0x02, 0x01, 0x51, 0x09, 0x06},
+    {0x32, 0x49, 0x79, 0x41, 0x3e}, {0x7e, 0x11, 0x11, 0x11, 0x7e},
+    {0x7f, 0x49, 0x49, 0x49, 0x36}, {0x3e, 0x41, 0x41, 0x41, 0x22},
+    {0x7f, 0x41, 0x41, 0x22, 0x1c}, {0x7f, 0x49, 0x49, 0x49, 0x41},
+    {0x7f, 0x09, 0x09, 0x01, 0x01}, {0x3e, 0x41, 0x41, 0x51, 0x32},
+    {0x7f, 0x08, 0x08, 0x08, 0x7f}, {0x00, 0x41, 0x7f, 0x41, 0x00},
+    {0x20, 0x40, 0x41, 0x3f, 0x01}, {0x7f, 0x08, 0x14, 0x22, 0x41},
+    {0x7f, 0x40, 0x40, 0x40, 0x40}, {0x7f, 0x02, 0x04, 0x02, 0x7f},
+    {0x7f, 0x04, 0x08, 0x10, 0x7f}, {0x3e, 0x41, 0x41, 0x41, 0x3e},
+    {0x7f, 0x09, 0x09, 0x09, 0x06}, {0x3e, 0x41, 0x51, 0x21, 0x5e},
+    {0x7f, 0x09, 0x19, 0x29, 0x46}, {0x46, 0x49, 0x49, 0x49, 0x31},
+    {0x01, 0x01, 0x7f, 0x01, 0x01}, {0x3f, 0x40, 0x40, 0x40, 0x3f},
+    {0x1f, 0x20, 0x40, 0x20, 0x1f}, {0x7f, 0x20, 0x18, 0x20, 0x7f},
+    {0x63, 0x14, 0x08, 0x14, 0x63}, {0x03, 0x04, 0x78, 0x04, 0x03},
+    {0x61, 0x51, 0x49, 0x45, 0x43}, {0x00, 0x7f, 0x41, 0x41, 0x00},
+    {0x02, 0x04, 0x08, 0x10, 0x20}, {0x00, 0x41, 0x41, 0x7f, 0x00},
+    {0x04, 0x02, 0x01, 0x02, 0x04}, {0x40, 0x40, 0x40, 0x40, 0x40},
+    {0x00, 0x01, 0x02, 0x04, 0x00}, {0x20, 0x54, 0x54, 0x54, 0x78},
+    {0x7f, 0x48, 0x44, 0x44, 0x38}, {0x38, 0x44, 0x44, 0x44, 0x20},
+    {0x38, 0x44, 0x44, 0x48, 0x7f}, {0x38, 0x54, 0x54, 0x54, 0x18},
+    {0x08, 0x7e, 0x09, 0x01, 0x02}, {0x08, 0x14, 0x54, 0x54, 0x3c},
+    {0x7f, 0x08, 0x04, 0x04, 0x78}, {0x00, 0x44, 0x7d, 0x40, 0x00},
+    {0x20, 0x40, 0x44, 0x3d, 0x00}, {0x00, 0x7f, 0x10, 0x28, 0x44},
+    {0x00, 0x41, 0x7f, 0x40, 0x00}, {0x7c, 0x04, 0x18, 0x04, 0x78},
+    {0x7c, 0x08, 0x04, 0x04, 0x78}, {0x38, 0x44, 0x44, 0x44, 0x38},
+    {0x7c, 0x14, 0x14, 0x14, 0x08}, {0x08, 0x14, 0x14, 0x18, 0x7c},
+    {0x7c, 0x08, 0x04, 0x04, 0x08}, {0x48, 0x54, 0x54, 0x54, 0x20},
+    {0x04, 0x3f, 0x44, 0x40, 0x20}, {0x3c, 0x40, 0x40, 0x20, 0x7c},
+    {0x1c, 0x20, 0x40, 0x20, 0x1c}, {0x3c, 0x40, 0x30, 0x40, 0x3c},
+    {0x44, 0x28, 0x10, 0x28, 0x44}, {0x0c, 0x50, 0x50, 0x50, 0x3c},
+    {0x44, 0x64, 0x54, 0x4c, 0x44}, {0x00, 0x08, 0x36, 0x41, 0x00},
+    {0x00, 0x00, 0x7f, 0x00, 0x00}, {0x00, 0x41, 0x36, 0x08, 0x00},
+    {0x08, 0x04, 0x08, 0x10, 0x08},
+};
+
+/// colours of one state, opaque ARGB
+struct palette
+{
+    uint32_t title_top;
+    uint32_t title_bottom;
+    uint32_t edge;
+    uint32_t text;
+    uint32_t button;
+    uint32_t button_mark;
+};
+
+constexpr palette palettes[2] = {
+    {0xff4a6ea9, 0xff3b5a8c, 0xff3b5a8c, 0xffffffff, 0xffc0392b, 0xffffffff},
+    {0xff4a4a4a, 0xff3a3a3a, 0xff3a3a3a, 0xffb0b0b0, 0xff5a5a5a, 0xffb0b0b0},
+};
+
+// every state gets a block of title column, edge and close button below
+// the glyph strips. stretched pieces are 3 pixels wide and sampled in the
+// middle so filtering never picks up a neighbour.
+constexpr int title_x = 0;
+constexpr int edge_x  = 4;
+constexpr int close_x = 8;
+
+int block_width(int scale)
+{
+    return close_x + decoration_atlas::button_size * scale + 1;
+}
+
+int blocks_y(int scale)
+{
+    return 2 * decoration_atlas::glyph_height * scale;
+}
+
+int state_index(decoration_state state)
+{
+    return state == decoration_state::focused ? 0 : 1;
+}
+
+/// draw c at x, y of an ARGB image, characters outside the font show as '?'
+void draw_glyph(uint32_t* pixels,
+                int       stride,
+                int       x,
+                int       y,
+                char      c,
+                int       scale,
+                uint32_t  color)
+{
+    if (c < first_glyph || c > last_glyph)
+    {
+        c = '?';
+    }
+
+    auto& columns = font[c - first_glyph];
+
+    for (int col = 0; col < 5; ++col)
+    {
+        for (int row = 0; row < 7; ++row)
+        {
+            if (!(columns[col] & (1 << row)))
+            {
+                continue;
+            }
+
+            for (int py = 0; py < scale; ++py)
+            {
+                std::fill_n(pixels + (y + row * scale + py) * stride + x +
+                                col * scale,
+                            scale,
+                            color);
+            }
+        }
+    }
+}
+
+uint32_t lerp(uint32_t a, uint32_t b, int num, int den)
+{
+    uint32_t out = 0xff000000;
+
+    for (int shift = 0; shift < 24; shift += 8)
+    {
+        int ca = (a >> shift) & 0xff;
+        int cb = (b >> shift) & 0xff;
+        int c  = ca + (cb - ca) * num / den;
+
+        out |= static_cast<uint32_t>(c) << shift;
+    }
+
+    return out;
+}
+
+wlr_box scaled(const wlr_box& box, const wlr_box& output_box, float scale)
+{
+    return {static_cast<int>((box.x - output_box.x) * scale),
+            static_cast<int>((box.y - output_box.y) * scale),
+            static_cast<int>(box.width * scale),
+            static_cast<int>(box.height * scale)};
+}
+} // namespace
+
+decoration_atlas::decoration_atlas(wlr_renderer* renderer)
+    : renderer_{renderer}, textures_{}
+{}
+
+decoration_atlas::~decoration_atlas()
+{
+    for (auto* texture : textures_)
+    {
+        if (texture)
+        {
+            wlr_texture_destroy(texture);
+        }
+    }
+}
+
+int decoration_atlas::size_class(float scale)
+{
+    int s = static_cast<int>(scale + 0.99f);
+
+    return std::clamp(s, 1, max_scale);
+}
+
+wlr_texture* decoration_atlas::texture(int size_class)
+{
+    auto& texture = textures_[size_class - 1];
+
+    if (!texture)
+    {
+        texture = rasterize(size_class);
+    }
+
+    return texture;
+}
+
+wlr_fbox decoration_atlas::glyph(decoration_state state, char c, int s)
+{
+    if (c < first_glyph || c > last_glyph)
+    {
+        c = '?';
+    }
+
+    return {static_cast<double>((c - first_glyph) * glyph_width * s),
+            static_cast<double>(state_index(state) * glyph_height * s),
+            static_cast<double>(glyph_width * s),
+            static_cast<double>(glyph_height * s)};
+}
+
+wlr_fbox decoration_atlas::title(decoration_state state, int s)
+{
+    return {static_cast<double>(state_index(state) * block_width(s) +
+                                title_x + 1),
+            static_cast<double>(blocks_y(s) + 1),
+            1,
+            static_cast<double>(title_height * s)};
+}
+
+wlr_fbox decoration_atlas::edge(decoration_state state, int s)
+{
+    return {static_cast<double>(state_index(state) * block_width(s) +
+                                edge_x + 1),
+            static_cast<double>(blocks_y(s) + 1),
+            1,
+            1};
+}
+
+wlr_fbox decoration_atlas::close(decoration_state state, int s)
+{
+    return {static_cast<double>(state_index(state) * block_width(s) +
+                                close_x),
+            static_cast<double>(blocks_y(s) + 1),
+            static_cast<double>(button_size * s),
+            static_cast<double>(button_size * s)};
+}
+
+wlr_texture* decoration_atlas::rasterize(int s)
+{
+    int width  = std::max(glyph_count * glyph_width * s, 2 * block_width(s));
+    int height = blocks_y(s) + title_height * s + 2;
+
+    std::vector<uint32_t> pixels(static_cast<std::size_t>(width) * height);
+
+    auto fill = [&](int x, int y, int w, int h, uint32_t color) {
+        for (int row = y; row < y + h; ++row)
+        {
+            std::fill_n(&pixels[static_cast<std::size_t>(row) * width + x],
+                        w,
+                        color);
+        }
+    };
+
+    for (int state = 0; state < 2; ++state)
+    {
+        auto& colors = palettes[state];
+
+        for (char c = first_glyph; c <= last_glyph; ++c)
+        {
+            draw_glyph(pixels.data(),
+                       width,
+                       (c - first_glyph) * glyph_width * s,
+                       state * glyph_height * s,
+                       c,
+                       s,
+                       colors.text);
+        }
+
+        int bx = state * block_width(s);
+        int by = blocks_y(s);
+        int th = title_height * s;
+
+        // one padding row above and below, same colour as the edge rows
+        for (int row = 0; row < th + 2; ++row)
+        {
+            int r = std::clamp(row - 1, 0, th - 1);
+            fill(bx + title_x,
+                 by + row,
+                 3,
+                 1,
+                 lerp(colors.title_top, colors.title_bottom, r, th - 1));
+        }
+
+        fill(bx + edge_x, by, 3, 3, colors.edge);
+
+        int bs = button_size * s;
+        fill(bx + close_x, by + 1, bs, bs, colors.button);
+
+        // a cross inset by a quarter of the button
+        int inset = bs / 4;
+        for (int i = inset; i < bs - inset; ++i)
+        {
+            for (int t = 0; t < s; ++t)
+            {
+                int x0 = std::min(i + t, bs - inset - 1);
+                fill(bx + close_x + x0, by + 1 + i, 1, 1, colors.button_mark);
+                fill(bx + close_x + bs - 1 - x0,
+                     by + 1 + i,
+                     1,
+                     1,
+                     colors.button_mark);
+            }
+        }
+    }
+
+    auto* texture = wlr_texture_from_pixels(renderer_,
+                                            WL_SHM_FORMAT_ARGB8888,
+                                            width * 4,
+                                            width,
+                                            height,
+                                            pixels.data());
+
+    if (!texture)
+    {
+        wlr_log(WLR_ERROR, "failed to create decoration atlas");
+    }
+
+    return texture;
+}
+
+void emit_decoration(std::vector<render_entry>& plan,
+                     wlr_texture*               atlas,
+                     int                        size_class,
+                     const decoration_layout&   layout,
+                     decoration_state           state,
+                     std::string_view           title,
+                     const plan_target&         target)
+{
+    wlr_box intersection;
+    if (!wlr_box_intersection(&intersection, &layout.bounds, &target.box))
+    {
+        return;
+    }
+
+    auto quad = [&](wlr_texture*    texture,
+                    const wlr_box&  box,
+                    const wlr_fbox& source) {
+        if (!wlr_box_intersection(&intersection, &box, &target.box))
+        {
+            return;
+        }
+
+        render_entry entry{};
+        entry.texture = texture;
+        entry.source  = source;
+        entry.box     = scaled(box, target.box, target.scale);
+
+        wlr_matrix_project_box(entry.matrix,
+                               &entry.box,
+                               WL_OUTPUT_TRANSFORM_NORMAL,
+                               0,
+                               target.transform_matrix);
+
+        plan.push_back(entry);
+    };
+
+    for (auto&& border : layout.borders)
+    {
+        quad(atlas, border, decoration_atlas::edge(state, size_class));
+    }
+
+    quad(atlas, layout.title, decoration_atlas::title(state, size_class));
+    quad(atlas, layout.close, decoration_atlas::close(state, size_class));
+
+    // one quad per glyph, all from the atlas so no texture is switched
+    constexpr int advance = decoration_atlas::glyph_width;
+
+    int x   = layout.text.x;
+    int end = layout.text.x + layout.text.width;
+
+    for (char c : title)
+    {
+        if (x + advance > end)
+        {
+            break;
+        }
+
+        if (c != ' ')
+        {
+            quad(atlas,
+                 {x, layout.text.y, advance, layout.text.height},
+                 decoration_atlas::glyph(state, c, size_class));
+        }
+
+        x += advance;
+    }
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "decoration_layout.hpp"
+#include "wlr.hpp"
+
+struct plan_target;
+struct render_entry;
+
+enum class decoration_state
+{
+    focused,
+    unfocused
+};
+
+/// title bar and border pieces of every state, plus a glyph strip for
+/// titles, rasterized once per size class into a single texture.
+/// views draw their decorations as sub-rectangles of it.
+class decoration_atlas
+{
+public:
+    // in logical pixels
+    static constexpr int border       = 2;
+    static constexpr int title_height = 18;
+    static constexpr int button_size  = 12;
+    static constexpr int glyph_width  = 6;
+    static constexpr int glyph_height = 8;
+
+    // size classes are integer scales, fractional outputs sample the
+    // next one up.
+    static constexpr int max_scale = 3;
+
+private:
+    wlr_renderer*                       renderer_;
+    std::array<wlr_texture*, max_scale> textures_;
+
+public:
+    decoration_atlas(wlr_renderer* renderer);
+    ~decoration_atlas();
+
+    decoration_atlas(const decoration_atlas&) = delete;
+    decoration_atlas& operator=(const decoration_atlas&) = delete;
+
+    static int size_class(float scale);
+
+    /// the atlas for a size class, rasterized on first use
+    wlr_texture* texture(int size_class);
+
+    // regions of the atlas in atlas pixels
+    static wlr_fbox glyph(decoration_state state, char c, int size_class);
+    static wlr_fbox title(decoration_state state, int size_class);
+    static wlr_fbox edge(decoration_state state, int size_class);
+    static wlr_fbox close(decoration_state state, int size_class);
+
+private:
+    wlr_texture* rasterize(int size_class);
+};
+
+/// append the quads of a decoration to an output's render plan, boxes
+/// are culled against and made relative to the output's layout box.
+/// atlas is the texture of size_class, title glyphs are drawn from it as
+/// far as they fit. touches no other state.
+void emit_decoration(std::vector<render_entry>& plan,
+                     wlr_texture*               atlas,
+                     int                        size_class,
+                     const decoration_layout&   layout,
+                     decoration_state           state,
+                     std::string_view           title,
+                     const plan_target&         target);
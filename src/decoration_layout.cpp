@@ -0,0 +1,78 @@
+#include "decoration_layout.hpp"
+
+#include <algorithm>
+
+#include "decoration_atlas.hpp"
+
+namespace
+{
+bool contains(const wlr_box& box, double lx, double ly)
+{
+    return lx >= box.x && ly >= box.y && lx < box.x + box.width &&
+           ly < box.y + box.height;
+}
+} // namespace
+
+decoration_layout decoration_layout::around(const wlr_box& content)
+{
+    constexpr int border = decoration_atlas::border;
+    constexpr int th     = decoration_atlas::title_height;
+    constexpr int bs     = decoration_atlas::button_size;
+    constexpr int pad    = (th - bs) / 2;
+
+    decoration_layout layout;
+
+    int cx = content.x;
+    int cy = content.y;
+    int cw = content.width;
+    int ch = content.height;
+
+    layout.bounds = {
+        cx - border, cy - th - border, cw + 2 * border, ch + th + 2 * border};
+
+    layout.title = {cx, cy - th, cw, th};
+    layout.close = {cx + cw - pad - bs, cy - th + pad, bs, bs};
+    layout.text  = {cx + pad,
+                   cy - th + (th - decoration_atlas::glyph_height) / 2,
+                   std::max(0, cw - bs - 3 * pad),
+                   decoration_atlas::glyph_height};
+
+    auto& b = layout.bounds;
+
+    layout.borders = {{
+        {b.x, b.y, b.width, border},
+        {b.x, cy + ch, b.width, border},
+        {b.x, cy - th, border, ch + th},
+        {cx + cw, cy - th, border, ch + th},
+    }};
+
+    return layout;
+}
+
+decoration_part decoration_layout::part_at(double lx, double ly) const
+{
+    if (!contains(bounds, lx, ly))
+    {
+        return decoration_part::none;
+    }
+
+    if (contains(close, lx, ly))
+    {
+        return decoration_part::close;
+    }
+
+    if (contains(title, lx, ly))
+    {
+        return decoration_part::title;
+    }
+
+    for (auto&& border : borders)
+    {
+        if (contains(border, lx, ly))
+        {
+            return decoration_part::border;
+        }
+    }
+
+    return decoration_part::none;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <array>
+
+#include "wlr.hpp"
+
+/// the part of a decoration under a point
+enum class decoration_part
+{
+    none,
+    title,
+    close,
+    border
+};
+
+/// server side decoration geometry of a view, in layout coordinates
+struct decoration_layout
+{
+    wlr_box title;
+    wlr_box close;
+    wlr_box text;
+    std::array<wlr_box, 4> borders;
+
+    /// everything the decoration covers
+    wlr_box bounds;
+
+    static decoration_layout around(const wlr_box& content);
+
+    decoration_part part_at(double lx, double ly) const;
+};
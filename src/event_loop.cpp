@@ -0,0 +1,90 @@
+#include "event_loop.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <ctime>
+
+#include <poll.h>
+
+#include "wlr.hpp"
+
+namespace
+{
+uint64_t now_ns()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+} // namespace
+
+loop_driver::loop_driver(wl_display* display, uint64_t budget_ns)
+    : display_{display}, loop_{wl_display_get_event_loop(display)},
+      running_{false}, budget_ns_{budget_ns}, stats_{},
+      arena_{arena_size}
+{}
+
+void loop_driver::run()
+{
+    running_ = true;
+
+    while (running_)
+    {
+        iterate(-1);
+    }
+}
+
+void loop_driver::stop()
+{
+    running_ = false;
+}
+
+void loop_driver::iterate(int timeout)
+{
+    // everything queued by the previous iteration goes out in one go
+    auto flush_start = now_ns();
+    wl_display_flush_clients(display_);
+    auto flush_ns = now_ns() - flush_start;
+
+    pollfd pfd{wl_event_loop_get_fd(loop_), POLLIN, 0};
+    if (poll(&pfd, 1, timeout) < 0 && errno != EINTR)
+    {
+        wlr_log_errno(WLR_ERROR, "failed to poll event loop");
+        running_ = false;
+        return;
+    }
+
+    // runs idle sources itself, before and after the fd sources
+    auto dispatch_start = now_ns();
+    wl_event_loop_dispatch(loop_, 0);
+    auto dispatch_ns = now_ns() - dispatch_start;
+
+    arena_.reset();
+
+    auto& stats = stats_;
+    ++stats.iterations;
+    stats.dispatch_last_ns = dispatch_ns;
+    stats.dispatch_max_ns  = std::max(stats.dispatch_max_ns, dispatch_ns);
+    stats.dispatch_total_ns += dispatch_ns;
+    stats.flush_max_ns = std::max(stats.flush_max_ns, flush_ns);
+    stats.flush_total_ns += flush_ns;
+
+    std::size_t bucket = 0;
+    for (auto us = dispatch_ns / 1000;
+         us > 0 && bucket + 1 < stats.histogram.size();
+         us >>= 1)
+    {
+        ++bucket;
+    }
+    ++stats.histogram[bucket];
+
+    if (dispatch_ns > budget_ns_)
+    {
+        ++stats.overruns;
+        wlr_log(WLR_DEBUG,
+                "event loop iteration took %luus, budget is %luus",
+                static_cast<unsigned long>(dispatch_ns / 1000),
+                static_cast<unsigned long>(budget_ns_ / 1000));
+    }
+}
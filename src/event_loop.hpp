@@ -0,0 +1,76 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+#include <wayland-server-core.h>
+
+#include "arena.hpp"
+
+struct loop_stats
+{
+    uint64_t iterations;
+    uint64_t dispatch_last_ns;
+    uint64_t dispatch_max_ns;
+    uint64_t dispatch_total_ns;
+    uint64_t flush_max_ns;
+    uint64_t flush_total_ns;
+    uint64_t overruns;
+
+    /// dispatch time histogram, bucket i counts iterations below 2^i us
+    std::array<uint64_t, 16> histogram;
+};
+
+/// drives the display's event loop in place of wl_display_run, to measure
+/// it. every iteration waits for work, dispatches it, then flushes all
+/// clients once. time spent waiting is kept apart from time spent working
+/// so the recorded numbers reflect actual load.
+/// it schedules nothing: input, frame and client fds all live in the one
+/// epoll set libwayland dispatches, so events can't be reordered or client
+/// dispatch cut short here, and nothing else bounds it either. the budget
+/// is only the threshold for counting an iteration as an overrun.
+class loop_driver
+{
+public:
+    static constexpr std::size_t arena_size = 256 * 1024;
+
+private:
+    wl_display*    display_;
+    wl_event_loop* loop_;
+    bool           running_;
+    uint64_t       budget_ns_;
+    loop_stats     stats_;
+    scratch_arena  arena_;
+
+public:
+    /// budget_ns is the dispatch time after which an iteration counts as
+    /// an overrun, it isn't enforced
+    loop_driver(wl_display* display, uint64_t budget_ns);
+
+    void run();
+    void stop();
+
+    /// run a single iteration, waiting at most timeout ms for events
+    void iterate(int timeout);
+
+    const loop_stats& stats() const
+    {
+        return stats_;
+    }
+
+    uint64_t budget_ns() const
+    {
+        return budget_ns_;
+    }
+
+    /// scratch memory for handlers, reset after every dispatch
+    scratch_arena& arena()
+    {
+        return arena_;
+    }
+
+    const scratch_arena& arena() const
+    {
+        return arena_;
+    }
+};
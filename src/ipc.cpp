@@ -0,0 +1,698 @@
+#include "ipc.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <memory_resource>
+#include <stdexcept>
+#include <type_traits>
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "alloc_counter.hpp"
+#include "client_tracker.hpp"
+#include "logger.hpp"
+#include "output.hpp"
+#include "server.hpp"
+#include "view.hpp"
+#include "workspace.hpp"
+
+namespace
+{
+// std::to_string hands back a heap string once a number outgrows the small
+// string buffer, these format in place instead.
+template <typename T, typename = std::enable_if_t<std::is_integral_v<T>>>
+void append_number(std::pmr::string& out, T value)
+{
+    char buf[24];
+    auto result = std::to_chars(std::begin(buf), std::end(buf), value);
+    out.append(buf, result.ptr);
+}
+
+void append_number(std::pmr::string& out, double value)
+{
+    char buf[64];
+    auto n = std::snprintf(buf, sizeof(buf), "%f", value);
+    out.append(buf, std::min(static_cast<std::size_t>(n), sizeof(buf) - 1));
+}
+
+void append_view(std::pmr::string& out, view& v)
+{
+    auto* toplevel = v.xdg_surface()->toplevel;
+
+    wlr_box geo;
+    wlr_xdg_surface_get_geometry(v.xdg_surface(), &geo);
+
+    out += "{\"id\":";
+    append_number(out, v.id());
+    out += ",\"title\":";
+    append_json_string(out, toplevel->title);
+    out += ",\"app_id\":";
+    append_json_string(out, toplevel->app_id);
+    out += ",\"mapped\":";
+    out += v.mapped() ? "true" : "false";
+    out += ",\"workspace\":";
+    append_number(
+        out, v.assigned_workspace() ? v.assigned_workspace()->index() + 1 : 0);
+    out += ",\"visible\":";
+    out += v.visible() ? "true" : "false";
+    out += ",\"x\":";
+    append_number(out, v.x);
+    out += ",\"y\":";
+    append_number(out, v.y);
+    out += ",\"width\":";
+    append_number(out, geo.width);
+    out += ",\"height\":";
+    append_number(out, geo.height);
+    out += '}';
+}
+
+void append_output(std::pmr::string& out, server& serv, output& o)
+{
+    auto* wlr_output = o.handle();
+    auto& stats      = o.stats();
+    auto* box = wlr_output_layout_get_box(serv.output_layout(), wlr_output);
+
+    out += "{\"name\":";
+    append_json_string(out, wlr_output->name);
+    out += ",\"x\":";
+    append_number(out, box ? box->x : 0);
+    out += ",\"y\":";
+    append_number(out, box ? box->y : 0);
+    out += ",\"width\":";
+    append_number(out, wlr_output->width);
+    out += ",\"height\":";
+    append_number(out, wlr_output->height);
+    out += ",\"refresh\":";
+    append_number(out, wlr_output->refresh);
+    out += ",\"scale\":";
+    append_number(out, wlr_output->scale);
+    out += ",\"enabled\":";
+    out += o.enabled() ? "true" : "false";
+    out += ",\"workspace\":";
+    append_number(out, o.active_workspace().index() + 1);
+    out += ",\"frames\":";
+    append_number(out, stats.frames);
+    out += ",\"frame_last_ns\":";
+    append_number(out, stats.last_ns);
+    out += ",\"frame_max_ns\":";
+    append_number(out, stats.max_ns);
+    out += ",\"frame_avg_ns\":";
+    append_number(out, stats.frames ? stats.total_ns / stats.frames : 0);
+    out += '}';
+}
+
+const char* level_names[] = {"silent", "error", "info", "debug"};
+
+unsigned long parse_number(std::string_view arg)
+{
+    unsigned long value = 0;
+    std::from_chars(arg.data(), arg.data() + arg.size(), value);
+
+    return value;
+}
+
+view* find_view(server& serv, std::string_view arg)
+{
+    auto id = parse_number(arg);
+
+    auto& views = serv.views();
+    auto  it =
+        std::find_if(std::begin(views), std::end(views), [&](auto&& v) {
+            return v->id() == id;
+        });
+
+    return it != std::end(views) ? it->get() : nullptr;
+}
+} // namespace
+
+ipc_client::ipc_client(ipc_server* owner, wl_event_loop* loop, int fd)
+    : owner_{owner}, fd_{fd},
+      source_{wl_event_loop_add_fd(
+          loop, fd, WL_EVENT_READABLE, ipc_server::handle_client, this)},
+      subscribed_{false}, closed_{false}
+{
+    if (!source_)
+    {
+        closed_ = true;
+    }
+}
+
+ipc_client::~ipc_client()
+{
+    if (source_)
+    {
+        wl_event_source_remove(source_);
+    }
+
+    ::close(fd_);
+}
+
+void ipc_client::send(std::string_view data)
+{
+    if (closed_)
+    {
+        return;
+    }
+
+    if (out_.size() + data.size() > ipc_server::max_write_buffer)
+    {
+        // slow reader, drop it instead of growing without bound
+        closed_ = true;
+        return;
+    }
+
+    out_.append(data.data(), data.size());
+    flush();
+}
+
+void ipc_client::flush()
+{
+    while (!out_.empty())
+    {
+        auto written = ::send(fd_, out_.data(), out_.size(), MSG_NOSIGNAL);
+
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+            {
+                closed_ = true;
+                return;
+            }
+
+            break;
+        }
+
+        out_.erase(0, static_cast<std::size_t>(written));
+    }
+
+    uint32_t mask = WL_EVENT_READABLE;
+    if (!out_.empty())
+    {
+        mask |= WL_EVENT_WRITABLE;
+    }
+
+    wl_event_source_fd_update(source_, mask);
+}
+
+ipc_server::ipc_server(server* serv,
+                       wl_event_loop* loop,
+                       const char*    display_name)
+    : server_{serv}, loop_{loop}, fd_{-1}, source_{nullptr}
+{
+    const char* runtime_dir = std::getenv("XDG_RUNTIME_DIR");
+    if (!runtime_dir)
+    {
+        throw std::runtime_error{"XDG_RUNTIME_DIR is not set"};
+    }
+
+    path_ = std::string{runtime_dir} + "/trinkster." + display_name + ".sock";
+
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+
+    if (path_.size() >= sizeof(addr.sun_path))
+    {
+        throw std::runtime_error{"ipc socket path too long"};
+    }
+
+    std::copy(std::begin(path_), std::end(path_), addr.sun_path);
+
+    fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd_ < 0)
+    {
+        throw std::runtime_error{"failed to create ipc socket"};
+    }
+
+    // a socket left behind by a crashed instance is ours to replace, one
+    // somebody still accepts on isn't.
+    int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (probe >= 0)
+    {
+        bool in_use =
+            connect(probe, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) ==
+            0;
+        ::close(probe);
+
+        if (in_use)
+        {
+            ::close(fd_);
+            throw std::runtime_error{"ipc socket " + path_ +
+                                     " is in use by another instance"};
+        }
+    }
+
+    unlink(path_.c_str());
+
+    if (bind(fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 ||
+        listen(fd_, 16) < 0)
+    {
+        ::close(fd_);
+        throw std::runtime_error{"failed to bind ipc socket"};
+    }
+
+    source_ = wl_event_loop_add_fd(
+        loop_, fd_, WL_EVENT_READABLE, handle_connection, this);
+
+    if (!source_)
+    {
+        ::close(fd_);
+        unlink(path_.c_str());
+        throw std::runtime_error{"failed to watch ipc socket"};
+    }
+
+    setenv("TRINKSTER_SOCK", path_.c_str(), true);
+
+    wlr_log(WLR_INFO, "IPC listening on %s", path_.c_str());
+}
+
+ipc_server::~ipc_server()
+{
+    clients_.clear();
+
+    if (source_)
+    {
+        wl_event_source_remove(source_);
+    }
+
+    ::close(fd_);
+    unlink(path_.c_str());
+}
+
+void ipc_server::broadcast(std::string_view event)
+{
+    bool any = false;
+
+    for (auto&& client : clients_)
+    {
+        if (client->subscribed())
+        {
+            client->send(event);
+            any = true;
+        }
+    }
+
+    if (any)
+    {
+        reap();
+    }
+}
+
+void ipc_server::reap()
+{
+    clients_.erase(std::remove_if(std::begin(clients_),
+                                  std::end(clients_),
+                                  [](auto&& c) { return c->closed(); }),
+                   std::end(clients_));
+}
+
+void ipc_server::handle_command(ipc_client& client, std::string_view line)
+{
+    auto& serv = *server_;
+
+    auto        space = line.find(' ');
+    auto        cmd   = line.substr(0, space);
+    std::string_view arg =
+        space == std::string_view::npos ? std::string_view{}
+                                        : line.substr(space + 1);
+
+    // replies are built in the loop's scratch arena, it is reset once this
+    // dispatch is over and send() has copied them out.
+    std::pmr::string reply{serv.loop().arena().resource()};
+
+    if (cmd == "views")
+    {
+        reply += '[';
+        for (auto&& v : serv.views())
+        {
+            if (reply.size() > 1)
+            {
+                reply += ',';
+            }
+            append_view(reply, *v);
+        }
+        reply += ']';
+    }
+    else if (cmd == "outputs")
+    {
+        reply += '[';
+        for (auto* o : serv.outputs())
+        {
+            if (reply.size() > 1)
+            {
+                reply += ',';
+            }
+            append_output(reply, serv, *o);
+        }
+        reply += ']';
+    }
+    else if (cmd == "input")
+    {
+        auto& input = serv.input_counters();
+
+        reply += "{\"motion\":";
+        append_number(reply, input.motion);
+        reply += ",\"button\":";
+        append_number(reply, input.button);
+        reply += ",\"axis\":";
+        append_number(reply, input.axis);
+        reply += ",\"key\":";
+        append_number(reply, input.key);
+        reply += '}';
+    }
+    else if (cmd == "stats")
+    {
+        uint64_t frames = 0;
+        uint64_t max_ns = 0;
+        for (auto* o : serv.outputs())
+        {
+            frames += o->stats().frames;
+            max_ns = std::max(max_ns, o->stats().max_ns);
+        }
+
+        uint64_t commits = 0;
+        serv.clients().for_each(
+            [&](const client_usage& usage) { commits += usage.commits; });
+
+        reply += "{\"pid\":";
+        append_number(reply, getpid());
+        reply += ",\"commits\":";
+        append_number(reply, commits);
+        reply += ",\"views\":";
+        append_number(reply, serv.views().size());
+        reply += ",\"outputs\":";
+        append_number(reply, serv.outputs().size());
+        reply += ",\"frames\":";
+        append_number(reply, frames);
+        reply += ",\"frame_max_ns\":";
+        append_number(reply, max_ns);
+        reply += ",\"ipc_clients\":";
+        append_number(reply, clients_.size());
+        if (auto* logger = async_logger::instance())
+        {
+            reply += ",\"log_dropped\":";
+            append_number(reply, logger->dropped());
+        }
+        if constexpr (alloc_counting)
+        {
+            auto allocs = allocation_stats();
+
+            reply += ",\"allocs\":";
+            append_number(reply, allocs.allocations);
+            reply += ",\"frees\":";
+            append_number(reply, allocs.deallocations);
+            reply += ",\"alloc_bytes\":";
+            append_number(reply, allocs.bytes);
+        }
+        reply += '}';
+    }
+    else if (cmd == "log_level")
+    {
+        auto* logger = async_logger::instance();
+        auto  it     = std::find(
+            std::begin(level_names), std::end(level_names), arg);
+
+        if (!logger)
+        {
+            reply += "{\"error\":\"no logger installed\"}";
+        }
+        else if (!arg.empty() && it == std::end(level_names))
+        {
+            reply += "{\"error\":\"unknown log level\"}";
+        }
+        else
+        {
+            if (!arg.empty())
+            {
+                logger->set_level(static_cast<wlr_log_importance>(
+                    it - std::begin(level_names)));
+            }
+
+            reply += "{\"level\":";
+            append_json_string(reply, level_names[logger->level()]);
+            reply += '}';
+        }
+    }
+    else if (cmd == "clients")
+    {
+        reply += '[';
+        serv.clients().for_each([&](const client_usage& usage) {
+            if (reply.size() > 1)
+            {
+                reply += ',';
+            }
+
+            reply += "{\"pid\":";
+            append_number(reply, usage.pid);
+            reply += ",\"surfaces\":";
+            append_number(reply, usage.surfaces);
+            reply += ",\"buffers\":";
+            append_number(reply, usage.buffers);
+            reply += ",\"shm_bytes\":";
+            append_number(reply, usage.shm_bytes);
+            reply += ",\"commits\":";
+            append_number(reply, usage.commits);
+            reply += ",\"commits_per_sec\":";
+            append_number(reply, usage.commits_per_sec);
+            reply += ",\"busy_ns\":";
+            append_number(reply, usage.busy_ns);
+            reply += ",\"throttled\":";
+            reply += usage.throttled ? "true" : "false";
+            reply += '}';
+        });
+        reply += ']';
+    }
+    else if (cmd == "loop")
+    {
+        auto& stats = serv.loop().stats();
+
+        reply += "{\"iterations\":";
+        append_number(reply, stats.iterations);
+        reply += ",\"dispatch_last_ns\":";
+        append_number(reply, stats.dispatch_last_ns);
+        reply += ",\"dispatch_max_ns\":";
+        append_number(reply, stats.dispatch_max_ns);
+        reply += ",\"dispatch_avg_ns\":";
+        append_number(
+            reply,
+            stats.iterations ? stats.dispatch_total_ns / stats.iterations : 0);
+        reply += ",\"flush_max_ns\":";
+        append_number(reply, stats.flush_max_ns);
+        reply += ",\"budget_ns\":";
+        append_number(reply, serv.loop().budget_ns());
+        reply += ",\"overruns\":";
+        append_number(reply, stats.overruns);
+        reply += ",\"arena_spills\":";
+        append_number(reply, serv.loop().arena().spills());
+        reply += ",\"histogram_us_log2\":[";
+        for (std::size_t i = 0; i < stats.histogram.size(); ++i)
+        {
+            if (i)
+            {
+                reply += ',';
+            }
+            append_number(reply, stats.histogram[i]);
+        }
+        reply += "]}";
+    }
+    else if (cmd == "subscribe")
+    {
+        client.subscribe();
+        reply += "{\"success\":true}";
+    }
+    else if (cmd == "close" || cmd == "focus")
+    {
+        auto* v = find_view(serv, arg);
+
+        if (!v)
+        {
+            reply += "{\"error\":\"no such view\"}";
+        }
+        else
+        {
+            if (cmd == "close")
+            {
+                wlr_xdg_toplevel_send_close(v->xdg_surface());
+            }
+            else
+            {
+                v->keyboard_focus(*v->xdg_surface()->surface);
+            }
+            reply += "{\"success\":true}";
+        }
+    }
+    else if (cmd == "workspace")
+    {
+        auto index = parse_number(arg);
+
+        if (index < 1 || index > output::workspace_count)
+        {
+            reply += "{\"error\":\"no such workspace\"}";
+        }
+        else
+        {
+            serv.switch_workspace(index - 1);
+            reply += "{\"success\":true}";
+        }
+    }
+    else if (cmd == "debug")
+    {
+        auto mode = serv.render_debug_mode();
+
+        std::pmr::string name{arg, reply.get_allocator()};
+
+        if (!arg.empty() && !parse_render_debug(name.c_str(), mode))
+        {
+            reply += "{\"error\":\"unknown debug mode\"}";
+        }
+        else
+        {
+            if (!arg.empty())
+            {
+                serv.set_render_debug_mode(mode);
+            }
+
+            reply += "{\"debug\":";
+            append_json_string(reply, render_debug_name(mode));
+            reply += '}';
+        }
+    }
+    else if (cmd == "motion")
+    {
+        std::pmr::string coords{arg, reply.get_allocator()};
+        double           x, y;
+
+        if (std::sscanf(coords.c_str(), "%lf %lf", &x, &y) != 2)
+        {
+            reply += "{\"error\":\"expected x and y\"}";
+        }
+        else
+        {
+            serv.warp_cursor(x, y);
+            reply += "{\"success\":true}";
+        }
+    }
+    else if (cmd == "exit")
+    {
+        serv.terminate();
+        reply += "{\"success\":true}";
+    }
+    else
+    {
+        reply += "{\"error\":\"unknown command\"}";
+    }
+
+    reply += '\n';
+    client.send(reply);
+}
+
+int ipc_server::handle_connection(int fd, uint32_t mask, void* data)
+{
+    (void) mask;
+    auto* self = static_cast<ipc_server*>(data);
+
+    int client_fd = accept4(fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (client_fd < 0)
+    {
+        wlr_log_errno(WLR_ERROR, "failed to accept ipc client");
+        return 0;
+    }
+
+    auto client = std::make_unique<ipc_client>(self, self->loop_, client_fd);
+    if (client->closed())
+    {
+        wlr_log(WLR_ERROR, "failed to watch ipc client");
+        return 0;
+    }
+
+    self->clients_.push_back(std::move(client));
+
+    return 0;
+}
+
+int ipc_server::handle_client(int fd, uint32_t mask, void* data)
+{
+    auto* client = static_cast<ipc_client*>(data);
+    auto* self   = client->owner();
+
+    if (mask & (WL_EVENT_HANGUP | WL_EVENT_ERROR))
+    {
+        client->close();
+    }
+
+    if (!client->closed() && (mask & WL_EVENT_WRITABLE))
+    {
+        client->flush();
+    }
+
+    if (!client->closed() && (mask & WL_EVENT_READABLE))
+    {
+        auto& in = client->input();
+        char  buf[1024];
+
+        for (;;)
+        {
+            auto n = recv(fd, buf, sizeof(buf), 0);
+
+            if (n == 0)
+            {
+                client->close();
+                break;
+            }
+
+            if (n < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+
+                if (errno != EAGAIN && errno != EWOULDBLOCK)
+                {
+                    client->close();
+                }
+                break;
+            }
+
+            in.append(buf, static_cast<std::size_t>(n));
+
+            std::size_t start = 0;
+            std::size_t end;
+            while (!client->closed() &&
+                   (end = in.find('\n', start)) != std::string::npos)
+            {
+                self->handle_command(
+                    *client, std::string_view{in}.substr(start, end - start));
+                start = end + 1;
+            }
+
+            in.erase(0, start);
+
+            // only a single command can get too long, pipelining many
+            // short ones is fine
+            if (!client->closed() && in.size() > max_read_buffer)
+            {
+                client->close();
+            }
+
+            if (client->closed())
+            {
+                break;
+            }
+        }
+    }
+
+    self->reap();
+
+    return 0;
+}
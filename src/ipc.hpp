@@ -0,0 +1,153 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <wayland-server-core.h>
+
+class server;
+class ipc_server;
+
+/// append str to out as a quoted JSON string, escaping as needed
+template <typename String>
+void append_json_string(String& out, const char* str)
+{
+    out += '"';
+
+    for (; str && *str; ++str)
+    {
+        char c = *str;
+
+        switch (c)
+        {
+        case '"':
+            out += "\\\"";
+            break;
+        case '\\':
+            out += "\\\\";
+            break;
+        case '\n':
+            out += "\\n";
+            break;
+        case '\t':
+            out += "\\t";
+            break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20)
+            {
+                char buf[8];
+                std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+                out += buf;
+            }
+            else
+            {
+                out += c;
+            }
+            break;
+        }
+    }
+
+    out += '"';
+}
+
+/// a connection on the control socket.
+/// all writes go through a bounded buffer, a client that lets it fill up is
+/// dropped instead of blocking the event loop.
+class ipc_client
+{
+private:
+    ipc_server*      owner_;
+    int              fd_;
+    wl_event_source* source_;
+    std::string      in_;
+    std::string      out_;
+    bool             subscribed_;
+    bool             closed_;
+
+public:
+    ipc_client(ipc_server* owner, wl_event_loop* loop, int fd);
+    ~ipc_client();
+
+    ipc_client(const ipc_client&) = delete;
+    ipc_client& operator=(const ipc_client&) = delete;
+
+    ipc_server* owner()
+    {
+        return owner_;
+    }
+
+    bool subscribed() const
+    {
+        return subscribed_;
+    }
+
+    void subscribe()
+    {
+        subscribed_ = true;
+    }
+
+    bool closed() const
+    {
+        return closed_;
+    }
+
+    void close()
+    {
+        closed_ = true;
+    }
+
+    std::string& input()
+    {
+        return in_;
+    }
+
+    /// queue data for this client and try to write it out right away
+    void send(std::string_view data);
+
+    /// write out as much of the pending buffer as the socket takes
+    void flush();
+};
+
+class ipc_server
+{
+    friend class ipc_client;
+
+private:
+    server*          server_;
+    wl_event_loop*   loop_;
+    int              fd_;
+    std::string      path_;
+    wl_event_source* source_;
+
+    std::vector<std::unique_ptr<ipc_client>> clients_;
+
+public:
+    static constexpr std::size_t max_read_buffer  = 4 * 1024;
+    static constexpr std::size_t max_write_buffer = 64 * 1024;
+
+public:
+    ipc_server(server* serv, wl_event_loop* loop, const char* display_name);
+    ~ipc_server();
+
+    ipc_server(const ipc_server&) = delete;
+    ipc_server& operator=(const ipc_server&) = delete;
+
+    const std::string& path() const
+    {
+        return path_;
+    }
+
+    /// send a single event line to every subscribed client
+    void broadcast(std::string_view event);
+
+private:
+    void handle_command(ipc_client& client, std::string_view line);
+    void reap();
+
+    static int handle_connection(int fd, uint32_t mask, void* data);
+    static int handle_client(int fd, uint32_t mask, void* data);
+};
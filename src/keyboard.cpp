@@ -16,6 +16,8 @@ keyboard::keyboard(server* serv, wlr_input_device* device)
           auto*     event  = static_cast<wlr_event_keyboard_key*>(data);
           auto*     seat   = server->seat();
 
+          ++server->input_counters().key;
+
           // translate libinput to xkbcommon keycode
           uint32_t keycode = event->keycode + 8;
           // get a list of keysyms based on the keymap for this keyboard
@@ -33,7 +35,7 @@ keyboard::keyboard(server* serv, wlr_input_device* device)
               event->state == WLR_KEY_PRESSED)
           {
               // handle super presses as compositor events
-              // TODO handle these keybinds
+              handled = self->handle_keybinding(modifiers, keycode);
           }
 
           if (!handled)
@@ -59,4 +61,43 @@ keyboard::keyboard(server* serv, wlr_input_device* device)
     wl::connect(device_->keyboard->events.key, key_);
 
     wlr_seat_set_keyboard(serv->seat(), device_);
-}
\ No newline at end of file
+}
+
+bool keyboard::handle_keybinding(uint32_t modifiers, uint32_t keycode)
+{
+    // look at the unshifted symbols so super+shift+1 still reads as 1
+    const xkb_keysym_t* syms;
+    int                 nsyms = xkb_keymap_key_get_syms_by_level(
+        device_->keyboard->keymap, keycode, 0, 0, &syms);
+
+    for (int i = 0; i < nsyms; ++i)
+    {
+        if (syms[i] == XKB_KEY_F12)
+        {
+            // cycle off, damage, overdraw
+            auto mode = static_cast<render_debug>(
+                (static_cast<int>(server_->render_debug_mode()) + 1) % 3);
+            server_->set_render_debug_mode(mode);
+
+            return true;
+        }
+
+        if (syms[i] >= XKB_KEY_1 && syms[i] <= XKB_KEY_9)
+        {
+            std::size_t index = syms[i] - XKB_KEY_1;
+
+            if (modifiers & WLR_MODIFIER_SHIFT)
+            {
+                server_->move_focused_to_workspace(index);
+            }
+            else
+            {
+                server_->switch_workspace(index);
+            }
+
+            return true;
+        }
+    }
+
+    return false;
+}
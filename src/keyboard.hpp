@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstdint>
+
 #include "wl/listener.hpp"
 #include "wlr.hpp"
 
@@ -16,4 +18,7 @@ private:
 
 public:
     keyboard(server* serv, wlr_input_device* device);
+
+    /// returns whether the key was consumed by the compositor
+    bool handle_keybinding(uint32_t modifiers, uint32_t keycode);
 };
\ No newline at end of file
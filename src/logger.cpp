@@ -0,0 +1,235 @@
+#include "logger.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+#include <unistd.h>
+
+async_logger* async_logger::instance_ = nullptr;
+
+namespace
+{
+const char* importance_tag(wlr_log_importance importance)
+{
+    switch (importance)
+    {
+    case WLR_ERROR:
+        return "ERROR";
+    case WLR_INFO:
+        return "INFO";
+    case WLR_DEBUG:
+        return "DEBUG";
+    default:
+        return "";
+    }
+}
+
+void write_all(int fd, const char* data, std::size_t size)
+{
+    while (size > 0)
+    {
+        auto written = write(fd, data, size);
+
+        if (written <= 0)
+        {
+            return;
+        }
+
+        data += written;
+        size -= static_cast<std::size_t>(written);
+    }
+}
+} // namespace
+
+async_logger::async_logger(wlr_log_importance level, int fd)
+    : slots_{std::make_unique<std::array<slot, capacity>>()}, enqueue_pos_{0},
+      dequeue_pos_{0}, dropped_{0}, level_{level}, running_{true}, fd_{fd}
+{
+    for (std::size_t i = 0; i < capacity; ++i)
+    {
+        (*slots_)[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start_);
+
+    thread_   = std::thread{[this] { run(); }};
+    instance_ = this;
+
+    wlr_log_init(level, handle_log);
+}
+
+async_logger::~async_logger()
+{
+    instance_ = nullptr;
+
+    running_.store(false, std::memory_order_release);
+    thread_.join();
+}
+
+void async_logger::set_level(wlr_log_importance level) noexcept
+{
+    level_.store(level, std::memory_order_relaxed);
+
+    // wlroots calls a custom callback whatever the verbosity, log() filters
+    // on level_ before formatting. this only keeps wlr_log_get_verbosity in
+    // line for code that checks it.
+    wlr_log_init(level, handle_log);
+}
+
+void async_logger::log(wlr_log_importance importance,
+                       const char*        fmt,
+                       va_list            args)
+{
+    if (importance > level())
+    {
+        return;
+    }
+
+    // bounded mpmc queue, see Dmitry Vyukov's design
+    slot*       cell;
+    std::size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+
+    for (;;)
+    {
+        cell = &(*slots_)[pos % capacity];
+
+        auto seq  = cell->sequence.load(std::memory_order_acquire);
+        auto diff = static_cast<std::ptrdiff_t>(seq) -
+                    static_cast<std::ptrdiff_t>(pos);
+
+        if (diff == 0)
+        {
+            if (enqueue_pos_.compare_exchange_weak(
+                    pos, pos + 1, std::memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        else if (diff < 0)
+        {
+            // full, never wait on the writer thread
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        else
+        {
+            pos = enqueue_pos_.load(std::memory_order_relaxed);
+        }
+    }
+
+    cell->importance = importance;
+    clock_gettime(CLOCK_MONOTONIC, &cell->time);
+    std::vsnprintf(cell->text, message_size, fmt, args);
+
+    cell->sequence.store(pos + 1, std::memory_order_release);
+}
+
+bool async_logger::drain()
+{
+    // formatted output is batched so a burst costs a handful of writes
+    char        buf[8192];
+    std::size_t used  = 0;
+    bool        found = false;
+
+    auto pos = dequeue_pos_.load(std::memory_order_relaxed);
+
+    for (;;)
+    {
+        auto& cell = (*slots_)[pos % capacity];
+
+        if (cell.sequence.load(std::memory_order_acquire) != pos + 1)
+        {
+            break;
+        }
+
+        found = true;
+
+        auto elapsed_ms = (cell.time.tv_sec - start_.tv_sec) * 1000 +
+                          (cell.time.tv_nsec - start_.tv_nsec) / 1000000;
+
+        if (used + message_size + 64 > sizeof(buf))
+        {
+            write_all(fd_, buf, used);
+            used = 0;
+        }
+
+        int n = std::snprintf(buf + used,
+                              sizeof(buf) - used,
+                              "%02ld:%02ld:%02ld.%03ld [%s] %s\n",
+                              elapsed_ms / 3600000,
+                              (elapsed_ms / 60000) % 60,
+                              (elapsed_ms / 1000) % 60,
+                              elapsed_ms % 1000,
+                              importance_tag(cell.importance),
+                              cell.text);
+
+        if (n > 0)
+        {
+            used += std::min(static_cast<std::size_t>(n), sizeof(buf) - used);
+        }
+
+        cell.sequence.store(pos + capacity, std::memory_order_release);
+        ++pos;
+    }
+
+    dequeue_pos_.store(pos, std::memory_order_relaxed);
+
+    if (used)
+    {
+        write_all(fd_, buf, used);
+    }
+
+    return found;
+}
+
+void async_logger::run()
+{
+    using namespace std::chrono_literals;
+
+    uint64_t reported = 0;
+    auto     backoff  = 1ms;
+
+    while (running_.load(std::memory_order_acquire))
+    {
+        if (drain())
+        {
+            backoff = 1ms;
+        }
+        else
+        {
+            std::this_thread::sleep_for(backoff);
+            backoff = std::min(backoff * 2, std::chrono::milliseconds{16});
+        }
+
+        auto dropped = dropped_.load(std::memory_order_relaxed);
+        if (dropped != reported)
+        {
+            char msg[64];
+            auto count = static_cast<unsigned long>(dropped - reported);
+            int  n     = std::snprintf(
+                msg, sizeof(msg), "[logger] dropped %lu messages\n", count);
+            write_all(fd_, msg, static_cast<std::size_t>(n));
+            reported = dropped;
+        }
+    }
+
+    drain();
+}
+
+void async_logger::handle_log(wlr_log_importance importance,
+                              const char*        fmt,
+                              va_list            args)
+{
+    if (auto* self = instance_)
+    {
+        self->log(importance, fmt, args);
+    }
+    else
+    {
+        // logger is gone, fall back to writing synchronously
+        std::vfprintf(stderr, fmt, args);
+        std::fputc('\n', stderr);
+    }
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdarg>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <thread>
+
+#include "wlr.hpp"
+
+/// wlr_log backend which formats messages into a fixed size ring buffer and
+/// leaves the actual writing to a background thread.
+/// when the ring is full messages are dropped and counted, logging never
+/// blocks the caller.
+class async_logger
+{
+public:
+    static constexpr std::size_t capacity     = 1024;
+    static constexpr std::size_t message_size = 512;
+
+private:
+    struct slot
+    {
+        std::atomic<std::size_t> sequence;
+        wlr_log_importance       importance;
+        timespec                 time;
+        char                     text[message_size];
+    };
+
+    static async_logger* instance_;
+
+    std::unique_ptr<std::array<slot, capacity>> slots_;
+    alignas(64) std::atomic<std::size_t> enqueue_pos_;
+    alignas(64) std::atomic<std::size_t> dequeue_pos_;
+
+    std::atomic<uint64_t>           dropped_;
+    std::atomic<wlr_log_importance> level_;
+    std::atomic<bool>               running_;
+    timespec                        start_;
+    int                             fd_;
+    std::thread                     thread_;
+
+public:
+    /// install as wlr_log callback writing to fd
+    async_logger(wlr_log_importance level, int fd = 2);
+    ~async_logger();
+
+    async_logger(const async_logger&) = delete;
+    async_logger& operator=(const async_logger&) = delete;
+
+    /// the currently installed logger, nullptr if none
+    static async_logger* instance() noexcept
+    {
+        return instance_;
+    }
+
+    void set_level(wlr_log_importance level) noexcept;
+
+    wlr_log_importance level() const noexcept
+    {
+        return level_.load(std::memory_order_relaxed);
+    }
+
+    uint64_t dropped() const noexcept
+    {
+        return dropped_.load(std::memory_order_relaxed);
+    }
+
+    void log(wlr_log_importance importance, const char* fmt, va_list args);
+
+private:
+    bool drain();
+    void run();
+
+    static void
+    handle_log(wlr_log_importance importance, const char* fmt, va_list args);
+};
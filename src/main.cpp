@@ -1,19 +1,45 @@
+#include <cstdlib>
+#include <cstring>
 #include <vector>
 
 #include <wayland-client.h>
 #include <wayland-server.h>
 
 #include "keyboard.hpp"
+#include "logger.hpp"
 #include "server.hpp"
 #include "view.hpp"
 #include "wlr.hpp"
 
+static wlr_log_importance log_level_from_env()
+{
+    const char* env = std::getenv("TRINKSTER_LOG_LEVEL");
+
+    if (env)
+    {
+        if (std::strcmp(env, "silent") == 0)
+        {
+            return WLR_SILENT;
+        }
+        else if (std::strcmp(env, "error") == 0)
+        {
+            return WLR_ERROR;
+        }
+        else if (std::strcmp(env, "info") == 0)
+        {
+            return WLR_INFO;
+        }
+    }
+
+    return WLR_DEBUG;
+}
+
 int main(int argc, char** argv)
 {
     (void) argc;
     (void) argv;
 
-    wlr_log_init(WLR_DEBUG, nullptr);
+    async_logger logger{log_level_from_env()};
 
     ::server server{wl_display_create()};
 
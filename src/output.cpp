@@ -2,98 +2,685 @@
 
 #include <algorithm>
 
+#include "client_tracker.hpp"
+#include "decoration_atlas.hpp"
+#include "render_debug.hpp"
 #include "server.hpp"
 #include "view.hpp"
+#include "viewporter.hpp"
 
-struct render_data
+static uint64_t to_ns(const timespec& ts)
 {
-    ::server*     server;
-    wlr_output*   output;
-    ::view*       view;
-    wlr_renderer* renderer;
-    timespec*     when;
-};
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+static bool overlaps(const wlr_box& a, const wlr_box& b)
+{
+    wlr_box intersection;
+    return wlr_box_intersection(&intersection, &a, &b);
+}
 
-static void render_surface(wlr_surface* surface, int sx, int sy, void* data)
+/// whether v is one of server::visible_views() and mapped, which is what a
+/// full capture walks
+static bool drawn(const view& v)
 {
-    auto& rdata  = *static_cast<render_data*>(data);
-    auto& server = *rdata.server;
-    auto& view   = *rdata.view;
-    auto* output = rdata.output;
+    return v.mapped() && v.visible() &&
+           v.assigned_workspace()->get_output()->enabled();
+}
+
+output::output(server* serv, wlr_output* output)
+    : server_{serv}, wlr_output_{output},
+      damage_{wlr_output_damage_create(output)}, frame_{[](auto* listener,
+                                                          void* data) {
+          (void) data;
+          ::output* self = wl_container_of(listener, self, frame_);
+
+          struct timespec now;
+          clock_gettime(CLOCK_MONOTONIC, &now);
+
+          // a request dispatched earlier in this iteration ends here
+          self->server_->clients().settle(to_ns(now));
+
+          bool              needs_frame;
+          pixman_region32_t damage;
+          pixman_region32_init(&damage);
+
+          if (!wlr_output_damage_attach_render(
+                  self->damage_, &needs_frame, &damage))
+          {
+              pixman_region32_fini(&damage);
+              return;
+          }
+
+          // a plan from the worker is patched up below like any other
+          if (self->worker_ && self->worker_->collect())
+          {
+              self->plan_.swap(self->pending_);
+              self->spans_.swap(self->pending_spans_);
+          }
+
+          // get the other outputs' workers going before building our own
+          // plan, so theirs are ready by the time their frames come
+          if (self->plan_dirty_)
+          {
+              self->server_->prepare_plans(*self);
+          }
+
+          self->update_plan();
+
+          if (needs_frame)
+          {
+              self->render(damage, now);
+          }
+          else
+          {
+              // nothing to repaint, a hardware cursor move or a client
+              // waiting on its frame callback gets us here.
+              wlr_output_rollback(self->wlr_output_);
+
+              auto& clients = self->server_->clients();
+              for (auto&& entry : self->plan_)
+              {
+                  if (entry.surface &&
+                      clients.frame_allowed(entry.usage, to_ns(now)))
+                  {
+                      wlr_surface_send_frame_done(entry.surface, &now);
+                  }
+              }
+          }
+
+          pixman_region32_fini(&damage);
 
-    auto* texture = wlr_surface_get_texture(surface);
+          struct timespec end;
+          clock_gettime(CLOCK_MONOTONIC, &end);
 
-    if (!texture)
+          uint64_t elapsed = to_ns(end) - to_ns(now);
+
+          auto& stats = self->stats_;
+          ++stats.frames;
+          stats.last_ns = elapsed;
+          stats.max_ns  = std::max(stats.max_ns, elapsed);
+          stats.total_ns += elapsed;
+      }},
+      mode_{[](auto* listener, void*) {
+          ::output* self = wl_container_of(listener, self, mode_);
+          self->invalidate();
+      }},
+      transform_{[](auto* listener, void*) {
+          ::output* self = wl_container_of(listener, self, transform_);
+          self->invalidate();
+      }},
+      scale_{[](auto* listener, void*) {
+          ::output* self = wl_container_of(listener, self, scale_);
+          self->invalidate();
+      }},
+      destroy_{[](auto* listener, void*) {
+          ::output* self = wl_container_of(listener, self, destroy_);
+          self->server_->remove_output(*self);
+      }},
+      stats_{}, active_{0}, plan_dirty_{true}, snapshot_{},
+      worker_{serv->parallel_outputs() ? std::make_unique<plan_worker>()
+                                       : nullptr}
+{
+    workspaces_.reserve(workspace_count);
+    for (std::size_t i = 0; i < workspace_count; ++i)
+    {
+        workspaces_.emplace_back(this, i);
+    }
+
+    wl::connect(damage_->events.frame, frame_);
+    wl::connect(wlr_output_->events.mode, mode_);
+    wl::connect(wlr_output_->events.transform, transform_);
+    wl::connect(wlr_output_->events.scale, scale_);
+
+    // ahead of the damage tracker, which takes its frame signal along
+    wl::connect_first(wlr_output_->events.destroy, destroy_);
+}
+
+output::~output()
+{
+    frame_.remove();
+    mode_.remove();
+    transform_.remove();
+    scale_.remove();
+    destroy_.remove();
+
+    wlr_output_->data = nullptr;
+}
+
+void output::invalidate_view(const view& v)
+{
+    if (plan_dirty_ || std::find(std::begin(stale_views_),
+                                 std::end(stale_views_),
+                                 &v) != std::end(stale_views_))
     {
         return;
     }
 
-    double ox = 0.0, oy = 0.0;
-    wlr_output_layout_output_coords(server.output_layout(), output, &ox, &oy);
-    ox += view.x + sx;
-    oy += view.y + sy;
+    stale_views_.push_back(&v);
+}
+
+void output::forget_view(const view& v)
+{
+    stale_views_.erase(
+        std::remove(std::begin(stale_views_), std::end(stale_views_), &v),
+        std::end(stale_views_));
 
-    wlr_box box{static_cast<int>(ox * output->scale),
-                static_cast<int>(oy * output->scale),
-                static_cast<int>(surface->current.width * output->scale),
-                static_cast<int>(surface->current.height * output->scale)};
+    if (plan_dirty_)
+    {
+        return;
+    }
 
-    float matrix[9];
-    auto  transform = wlr_output_transform_invert(surface->current.transform);
-    wlr_matrix_project_box(
-        matrix, &box, transform, 0, output->transform_matrix);
+    // the worker has the snapshot, whatever it builds gets replaced
+    if (worker_ && worker_->busy())
+    {
+        invalidate();
+        return;
+    }
 
-    wlr_render_texture_with_matrix(rdata.renderer, texture, matrix, 1);
+    auto first = std::begin(snapshot_.views);
+    auto last  = first + snapshot_.count;
+    auto slot  = std::find_if(
+        first, last, [&](auto&& entry) { return entry.source == &v; });
 
-    wlr_surface_send_frame_done(surface, rdata.when);
+    if (slot != last)
+    {
+        remove_slot(slot - first);
+    }
 }
 
-output::output(server* serv, wlr_output* output)
-    : server_{serv}, wlr_output_{output}, frame_{[](auto* listener,
-                                                    void* data) {
-          (void) data;
-          ::output* self     = wl_container_of(listener, self, frame_);
-          auto*     renderer = self->server_->renderer();
+bool output::touches(const wlr_box& box) const
+{
+    auto* layout_box =
+        wlr_output_layout_get_box(server_->output_layout(), wlr_output_);
 
-          struct timespec now;
-          clock_gettime(CLOCK_MONOTONIC, &now);
+    return layout_box && overlaps(box, *layout_box);
+}
 
-          if (!wlr_output_attach_render(self->wlr_output_, NULL))
-          {
-              return;
-          }
+void output::prepare_plan()
+{
+    if (!worker_ || !plan_dirty_ || worker_->busy())
+    {
+        return;
+    }
+
+    capture(snapshot_);
+    plan_dirty_ = false;
+    stale_views_.clear();
+
+    worker_->submit(snapshot_, pending_, pending_spans_);
+}
+
+void output::update_plan()
+{
+    if (plan_dirty_)
+    {
+        rebuild_plan();
+        return;
+    }
+
+    for (auto* v : stale_views_)
+    {
+        patch_view(*v);
+    }
+
+    stale_views_.clear();
+}
+
+void output::rebuild_plan()
+{
+    capture(snapshot_);
+    plan_dirty_ = false;
+    stale_views_.clear();
+
+    build_plan(snapshot_, plan_, spans_);
+}
+
+void output::capture(plan_snapshot& snapshot)
+{
+    snapshot.count = 0;
+    snapshot.atlas = nullptr;
+
+    auto* layout_box =
+        wlr_output_layout_get_box(server_->output_layout(), wlr_output_);
+
+    snapshot.placed = layout_box != nullptr;
+
+    if (!layout_box)
+    {
+        return;
+    }
+
+    auto& target = snapshot.target;
+    target.box   = *layout_box;
+    target.scale = wlr_output_->scale;
+    std::copy(std::begin(wlr_output_->transform_matrix),
+              std::end(wlr_output_->transform_matrix),
+              std::begin(target.transform_matrix));
+
+    snapshot.size_class = decoration_atlas::size_class(target.scale);
+
+    // views of other outputs which reach over here are drawn too, the
+    // surfaces of theirs which don't are culled by build_plan
+    auto& views = server_->visible_views();
+
+    for (auto it = views.rbegin(); it != views.rend(); ++it)
+    {
+        auto* v = *it;
+
+        if (!v->mapped() || !overlaps(v->bounds(), target.box))
+        {
+            continue;
+        }
+
+        if (snapshot.count == snapshot.views.size())
+        {
+            snapshot.views.emplace_back();
+        }
+
+        capture_view(snapshot, *v, snapshot.views[snapshot.count++]);
+    }
+}
+
+void output::capture_view(plan_snapshot& snapshot,
+                          const view&    v,
+                          plan_view&     entry)
+{
+    auto& clients = server_->clients();
+
+    entry.source   = &v;
+    entry.stacking = v.stacking();
+    entry.x        = v.x;
+    entry.y        = v.y;
+
+    entry.surfaces.clear();
+    entry.usages.clear();
+
+    for (auto&& surf : v.surfaces())
+    {
+        if (!surf.surface)
+        {
+            continue;
+        }
+
+        entry.surfaces.push_back(surf);
+        entry.usages.push_back(
+            clients.usage(wl_resource_get_client(surf.surface->resource)));
+    }
+
+    entry.decorated = v.server_side_decorated();
+
+    if (entry.decorated)
+    {
+        entry.decoration = v.decoration();
+        entry.state      = &v == server_->focused_view()
+                               ? decoration_state::focused
+                               : decoration_state::unfocused;
+        entry.title      = v.title();
+
+        // the atlas is rasterized on first use, which needs the renderer
+        // and so has to happen here rather than in build_plan
+        if (!snapshot.atlas)
+        {
+            snapshot.atlas = server_->atlas().texture(snapshot.size_class);
+        }
+    }
+}
+
+void output::patch_view(const view& v)
+{
+    auto first = std::begin(snapshot_.views);
+    auto last  = first + snapshot_.count;
+    auto slot  = std::find_if(
+        first, last, [&](auto&& entry) { return entry.source == &v; });
+
+    std::size_t index = slot - first;
+    bool        found = slot != last;
+
+    bool wanted = snapshot_.placed && drawn(v) &&
+                  overlaps(v.bounds(), snapshot_.target.box);
+
+    // a view put on another workspace is restacked as well
+    if (found && (!wanted || slot->stacking != v.stacking()))
+    {
+        remove_slot(index);
+        found = false;
+    }
+
+    if (!wanted)
+    {
+        return;
+    }
+
+    if (!found)
+    {
+        first = std::begin(snapshot_.views);
+        last  = first + snapshot_.count;
+        index = std::find_if(first,
+                             last,
+                             [&](auto&& entry) {
+                                 return entry.stacking > v.stacking();
+                             }) -
+                first;
+
+        insert_slot(index);
+    }
+
+    auto& entry = snapshot_.views[index];
+    capture_view(snapshot_, v, entry);
+
+    patch_.clear();
+    emit_view(snapshot_, entry, patch_);
+    replace_span(index);
+}
+
+void output::insert_slot(std::size_t index)
+{
+    auto& views = snapshot_.views;
+
+    if (snapshot_.count == views.size())
+    {
+        views.emplace_back();
+    }
+
+    // the spare past count moves in, so its buffers get reused
+    auto first = std::begin(views);
+    std::rotate(first + index,
+                first + snapshot_.count,
+                first + snapshot_.count + 1);
+    ++snapshot_.count;
+
+    auto begin = index < spans_.size() ? spans_[index].begin : plan_.size();
+    spans_.insert(std::begin(spans_) + index, {begin, 0});
+}
+
+void output::remove_slot(std::size_t index)
+{
+    patch_.clear();
+    replace_span(index);
+    spans_.erase(std::begin(spans_) + index);
+
+    // and the removed one moves out past count
+    auto first = std::begin(snapshot_.views);
+    std::rotate(first + index, first + index + 1, first + snapshot_.count);
+    --snapshot_.count;
+}
+
+void output::replace_span(std::size_t index)
+{
+    auto& span = spans_[index];
+    auto  at   = std::begin(plan_) + span.begin;
+
+    if (patch_.size() == span.count)
+    {
+        std::copy(std::begin(patch_), std::end(patch_), at);
+        return;
+    }
+
+    at = plan_.erase(at, at + span.count);
+    plan_.insert(at, std::begin(patch_), std::end(patch_));
+
+    for (auto i = index + 1; i < spans_.size(); ++i)
+    {
+        spans_[i].begin -= span.count;
+        spans_[i].begin += patch_.size();
+    }
+
+    span.count = patch_.size();
+}
+
+void output::switch_workspace(std::size_t index)
+{
+    if (index == active_ || index >= workspaces_.size())
+    {
+        return;
+    }
+
+    // views reaching onto other outputs come and go there as well
+    for (auto* v : active_workspace().views())
+    {
+        v->damage_whole();
+    }
+
+    active_ = index;
+    server_->invalidate_visible_views();
+
+    for (auto* v : active_workspace().views())
+    {
+        v->damage_whole();
+    }
+
+    server_->invalidate_render_plans();
+    damage_whole();
+
+    if (auto* top = active_workspace().topmost_mapped())
+    {
+        top->keyboard_focus(*top->xdg_surface()->surface);
+    }
+}
+
+void output::render(pixman_region32_t& damage, const timespec& now)
+{
+    auto* renderer = server_->renderer();
+
+    int width, height;
+    wlr_output_effective_resolution(wlr_output_, &width, &height);
+
+    wlr_renderer_begin(renderer, width, height);
+
+    int   nrects;
+    auto* rects = pixman_region32_rectangles(&damage, &nrects);
+
+    float color[4] = {0.3f, 0.3f, 0.3f, 1.0f};
+    for (int i = 0; i < nrects; ++i)
+    {
+        scissor(rects[i]);
+        wlr_renderer_clear(renderer, color);
+    }
+
+    pixman_region32_t surface_damage;
+    pixman_region32_init(&surface_damage);
+
+    auto& clients = server_->clients();
+    auto  now_ns  = to_ns(now);
+
+    auto           debug = server_->render_debug_mode();
+    render_summary summary{};
+
+    for (auto&& entry : plan_)
+    {
+        auto* texture = entry.get_texture();
+
+        if (!texture)
+        {
+            continue;
+        }
+
+        // frame callbacks are owed to everything visible, damaged or not,
+        // unless the client is over its budget.
+        if (entry.surface && clients.frame_allowed(entry.usage, now_ns))
+        {
+            wlr_surface_send_frame_done(entry.surface, &now);
+        }
 
-          int width, height;
-          wlr_output_effective_resolution(self->wlr_output_, &width, &height);
+        timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
 
-          wlr_renderer_begin(renderer, width, height);
+        pixman_region32_intersect_rect(&surface_damage,
+                                       &damage,
+                                       entry.box.x,
+                                       entry.box.y,
+                                       entry.box.width,
+                                       entry.box.height);
 
-          float color[4] = {0.3f, 0.3f, 0.3f, 1.0f};
-          wlr_renderer_clear(renderer, color);
+        rects = pixman_region32_rectangles(&surface_damage, &nrects);
+
+        if (debug != render_debug::off && nrects > 0)
+        {
+            ++summary.surfaces;
+            summary.pixels_drawn += region_area(surface_damage);
+        }
+
+        for (int i = 0; i < nrects; ++i)
+        {
+            scissor(rects[i]);
+
+            if (entry.source.width > 0)
+            {
+                wlr_render_subtexture_with_matrix(
+                    renderer, texture, &entry.source, entry.matrix, 1);
+            }
+            else
+            {
+                wlr_render_texture_with_matrix(
+                    renderer, texture, entry.matrix, 1);
+            }
+        }
+
+        if (entry.usage)
+        {
+            timespec end;
+            clock_gettime(CLOCK_MONOTONIC, &end);
+            entry.usage->busy_ns += to_ns(end) - to_ns(start);
+        }
+    }
+
+    pixman_region32_fini(&surface_damage);
+
+    if (debug != render_debug::off)
+    {
+        wlr_renderer_scissor(renderer, nullptr);
 
-          std::for_each(self->server_->views().rbegin(),
-                        self->server_->views().rend(),
-                        [&](auto&& v) {
-                            if (!v->mapped())
-                            {
-                                return;
-                            }
+        if (debug == render_debug::damage)
+        {
+            render_damage_overlay(renderer, wlr_output_, damage);
+        }
+        else
+        {
+            render_overdraw_overlay(renderer, wlr_output_, plan_, damage);
+        }
 
-                            render_data rdata{self->server_,
-                                              self->wlr_output_,
-                                              v.get(),
-                                              renderer,
-                                              &now};
+        summary.pixels_drawn += region_area(damage);
+        summary.pixels_output =
+            static_cast<uint64_t>(wlr_output_->width) * wlr_output_->height;
 
-                            wlr_xdg_surface_for_each_surface(
-                                v->xdg_surface(), render_surface, &rdata);
-                        });
+        wlr_log(WLR_INFO,
+                "%s frame %lu: %u surfaces, %lu pixels drawn, %lu output "
+                "pixels",
+                wlr_output_->name,
+                static_cast<unsigned long>(stats_.frames),
+                summary.surfaces,
+                static_cast<unsigned long>(summary.pixels_drawn),
+                static_cast<unsigned long>(summary.pixels_output));
+    }
+
+    // only draws cursors which didn't make it onto a cursor plane
+    wlr_output_render_software_cursors(wlr_output_, &damage);
+
+    wlr_renderer_scissor(renderer, nullptr);
+    wlr_renderer_end(renderer);
+
+    int tr_width, tr_height;
+    wlr_output_transformed_resolution(wlr_output_, &tr_width, &tr_height);
+
+    pixman_region32_t frame_damage;
+    pixman_region32_init(&frame_damage);
+
+    auto transform = wlr_output_transform_invert(wlr_output_->transform);
+    wlr_region_transform(
+        &frame_damage, &damage, transform, tr_width, tr_height);
+
+    wlr_output_set_damage(wlr_output_, &frame_damage);
+    pixman_region32_fini(&frame_damage);
+
+    wlr_output_commit(wlr_output_);
+}
+
+void output::scissor(const pixman_box32_t& rect)
+{
+    wlr_box box{rect.x1, rect.y1, rect.x2 - rect.x1, rect.y2 - rect.y1};
+
+    int width, height;
+    wlr_output_transformed_resolution(wlr_output_, &width, &height);
+
+    auto transform = wlr_output_transform_invert(wlr_output_->transform);
+    wlr_box_transform(&box, &box, transform, width, height);
+
+    wlr_renderer_scissor(server_->renderer(), &box);
+}
 
-          wlr_output_render_software_cursors(self->wlr_output_, nullptr);
+void output::damage_box(const wlr_box& box)
+{
+    auto* layout_box =
+        wlr_output_layout_get_box(server_->output_layout(), wlr_output_);
+
+    wlr_box intersection;
+    if (!layout_box ||
+        !wlr_box_intersection(&intersection, &box, layout_box))
+    {
+        return;
+    }
+
+    auto    scale = wlr_output_->scale;
+    wlr_box local{static_cast<int>((box.x - layout_box->x) * scale),
+                  static_cast<int>((box.y - layout_box->y) * scale),
+                  static_cast<int>(box.width * scale),
+                  static_cast<int>(box.height * scale)};
+
+    wlr_output_damage_add_box(damage_, &local);
+}
+
+void output::damage_surface(wlr_surface* surface, int lx, int ly)
+{
+    auto* layout_box =
+        wlr_output_layout_get_box(server_->output_layout(), wlr_output_);
+
+    auto& viewporter = server_->viewports();
+
+    wlr_box box{lx, ly, 0, 0};
+    viewporter.surface_size(surface, box.width, box.height);
+
+    wlr_box intersection;
+    if (!layout_box ||
+        !wlr_box_intersection(&intersection, &box, layout_box))
+    {
+        return;
+    }
+
+    if (viewporter.find(surface))
+    {
+        // the damage is in unscaled coordinates and wlr_region_scale only
+        // scales uniformly, repaint all of it.
+        damage_box(box);
+        return;
+    }
+
+    pixman_region32_t damage;
+    pixman_region32_init(&damage);
+    wlr_surface_get_effective_damage(surface, &damage);
+
+    if (pixman_region32_not_empty(&damage))
+    {
+        auto scale = wlr_output_->scale;
+
+        wlr_region_scale(&damage, &damage, scale);
+        pixman_region32_translate(
+            &damage,
+            static_cast<int>((lx - layout_box->x) * scale),
+            static_cast<int>((ly - layout_box->y) * scale));
+
+        wlr_output_damage_add(damage_, &damage);
+    }
+    else
+    {
+        // still need a frame so the client gets its frame callback
+        wlr_output_schedule_frame(wlr_output_);
+    }
+
+    pixman_region32_fini(&damage);
+}
 
-          wlr_renderer_end(renderer);
-          wlr_output_commit(self->wlr_output_);
-      }}
+void output::damage_whole()
 {
-    wl::connect(wlr_output_->events.frame, frame_);
+    wlr_output_damage_add_whole(damage_);
 }
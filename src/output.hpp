@@ -1,17 +1,145 @@
 #pragma once
 
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "plan_worker.hpp"
+#include "render_plan.hpp"
 #include "wl/listener.hpp"
 #include "wlr.hpp"
+#include "workspace.hpp"
 
 class server;
+class view;
+
+struct frame_stats
+{
+    uint64_t frames;
+    uint64_t last_ns;
+    uint64_t max_ns;
+    uint64_t total_ns;
+};
 
 class output
 {
+public:
+    static constexpr std::size_t workspace_count = 9;
+
 private:
-    server*      server_;
-    wlr_output*  wlr_output_;
-    wl::listener frame_;
+    server*            server_;
+    wlr_output*        wlr_output_;
+    wlr_output_damage* damage_;
+    wl::listener       frame_;
+    wl::listener mode_;
+    wl::listener transform_;
+    wl::listener scale_;
+    wl::listener destroy_;
+
+    frame_stats stats_;
+
+    std::vector<workspace> workspaces_;
+    std::size_t            active_;
+
+    // surfaces intersecting this output, bottom to top
+    std::vector<render_entry> plan_;
+    bool                      plan_dirty_;
+
+    // what plan_ was built from, kept so its buffers get reused. spans_
+    // has the part of plan_ each of its views drew.
+    plan_snapshot          snapshot_;
+    std::vector<plan_span> spans_;
+
+    // views to patch into the plan on the next frame, unless it gets
+    // rebuilt anyway
+    std::vector<const view*>  stale_views_;
+    std::vector<render_entry> patch_;
+
+    // with parallel outputs the worker builds the next plan into pending_
+    // from snapshot_, all three are off limits while it is busy.
+    std::vector<render_entry>    pending_;
+    std::vector<plan_span>       pending_spans_;
+    std::unique_ptr<plan_worker> worker_;
 
 public:
     output(server* serv, wlr_output* output);
-};
\ No newline at end of file
+    ~output();
+
+    output(const output&) = delete;
+    output& operator=(const output&) = delete;
+
+    wlr_output* handle()
+    {
+        return wlr_output_;
+    }
+
+    bool enabled() const
+    {
+        return wlr_output_->enabled;
+    }
+
+    const frame_stats& stats() const
+    {
+        return stats_;
+    }
+
+    const std::vector<render_entry>& plan() const
+    {
+        return plan_;
+    }
+
+    workspace& active_workspace()
+    {
+        return workspaces_[active_];
+    }
+
+    workspace& get_workspace(std::size_t index)
+    {
+        return workspaces_[index];
+    }
+
+    /// show another workspace, costs nothing beyond rebuilding the plan for
+    /// the views that become visible.
+    void switch_workspace(std::size_t index);
+
+    /// rebuild the whole plan on the next frame
+    void invalidate()
+    {
+        plan_dirty_ = true;
+    }
+
+    /// start rebuilding a stale plan on the worker, if there is one and it
+    /// has nothing else to do
+    void prepare_plan();
+
+    /// redo just the draws of v on the next frame
+    void invalidate_view(const view& v);
+
+    /// drop v from the plan right away, for views going away
+    void forget_view(const view& v);
+
+    /// whether a box in layout coordinates reaches onto this output
+    bool touches(const wlr_box& box) const;
+
+    /// damage a box given in layout coordinates
+    void damage_box(const wlr_box& box);
+
+    /// damage what the surface reported as changed in its last commit,
+    /// lx and ly being the position of the surface in layout coordinates
+    void damage_surface(wlr_surface* surface, int lx, int ly);
+
+    void damage_whole();
+
+private:
+    void update_plan();
+    void rebuild_plan();
+    void capture(plan_snapshot& snapshot);
+    void capture_view(plan_snapshot& snapshot, const view& v, plan_view& entry);
+
+    void patch_view(const view& v);
+    void insert_slot(std::size_t index);
+    void remove_slot(std::size_t index);
+    void replace_span(std::size_t index);
+    void render(pixman_region32_t& damage, const timespec& now);
+    void scissor(const pixman_box32_t& rect);
+};
@@ -0,0 +1,281 @@
+#include "output_config.hpp"
+
+#include <cmath>
+#include <cstdlib>
+
+namespace
+{
+bool parse_size(std::string_view value, int32_t& width, int32_t& height)
+{
+    auto x = value.find('x');
+
+    if (x == std::string_view::npos)
+    {
+        return false;
+    }
+
+    std::string w{value.substr(0, x)};
+    std::string h{value.substr(x + 1)};
+
+    width  = std::atoi(w.c_str());
+    height = std::atoi(h.c_str());
+
+    return width > 0 && height > 0;
+}
+
+bool parse_mode(std::string_view value, output_config& config)
+{
+    if (value == "preferred")
+    {
+        config.policy = mode_policy::preferred;
+        return true;
+    }
+
+    if (value == "highest")
+    {
+        config.policy = mode_policy::highest_refresh;
+        return true;
+    }
+
+    config.refresh = 0;
+
+    auto at = value.find('@');
+    if (at != std::string_view::npos)
+    {
+        std::string hz{value.substr(at + 1)};
+        config.refresh =
+            static_cast<int32_t>(std::lround(std::atof(hz.c_str()) * 1000));
+        value = value.substr(0, at);
+    }
+
+    return parse_size(value, config.width, config.height);
+}
+
+bool parse_position(std::string_view value, output_config& config)
+{
+    auto comma = value.find(',');
+
+    if (comma == std::string_view::npos)
+    {
+        return false;
+    }
+
+    std::string x{value.substr(0, comma)};
+    std::string y{value.substr(comma + 1)};
+
+    config.positioned = true;
+    config.x          = std::atoi(x.c_str());
+    config.y          = std::atoi(y.c_str());
+
+    return true;
+}
+
+std::string_view next_token(std::string_view& str, char delim)
+{
+    auto pos   = str.find(delim);
+    auto token = str.substr(0, pos);
+
+    str = pos == std::string_view::npos ? std::string_view{}
+                                        : str.substr(pos + 1);
+
+    return token;
+}
+
+std::string_view trim(std::string_view str)
+{
+    while (!str.empty() && (str.front() == ' ' || str.front() == '\t'))
+    {
+        str.remove_prefix(1);
+    }
+    while (!str.empty() && (str.back() == ' ' || str.back() == '\t'))
+    {
+        str.remove_suffix(1);
+    }
+
+    return str;
+}
+} // namespace
+
+const output_config& default_output_config()
+{
+    static const output_config config = {
+        "*", true, mode_policy::highest_refresh, 0, 0, 0, 0.f, false, 0, 0};
+
+    return config;
+}
+
+std::vector<output_config> output_configs_from_env()
+{
+    std::vector<output_config> configs;
+
+    const char* env = std::getenv("TRINKSTER_OUTPUTS");
+
+    if (!env)
+    {
+        return configs;
+    }
+
+    std::string_view rest{env};
+    while (!rest.empty())
+    {
+        auto entry = trim(next_token(rest, ';'));
+
+        if (entry.empty())
+        {
+            continue;
+        }
+
+        output_config config = default_output_config();
+        if (parse_output_config(entry, config))
+        {
+            configs.push_back(std::move(config));
+        }
+        else
+        {
+            wlr_log(WLR_ERROR,
+                    "ignoring output config \"%.*s\"",
+                    static_cast<int>(entry.size()),
+                    entry.data());
+        }
+    }
+
+    return configs;
+}
+
+bool parse_output_config(std::string_view entry, output_config& config)
+{
+    auto name = next_token(entry, ' ');
+
+    if (name.empty())
+    {
+        return false;
+    }
+
+    config.name = std::string{name};
+
+    while (!entry.empty())
+    {
+        auto field = trim(next_token(entry, ' '));
+
+        if (field.empty())
+        {
+            continue;
+        }
+
+        auto key = next_token(field, '=');
+
+        if (key == "off" || key == "disable")
+        {
+            config.enabled = false;
+        }
+        else if (key == "on" || key == "enable")
+        {
+            config.enabled = true;
+        }
+        else if (key == "mode")
+        {
+            if (!parse_mode(field, config))
+            {
+                return false;
+            }
+        }
+        else if (key == "scale")
+        {
+            std::string value{field};
+            config.scale = std::atof(value.c_str());
+
+            if (config.scale <= 0.f)
+            {
+                return false;
+            }
+        }
+        else if (key == "pos")
+        {
+            if (!parse_position(field, config))
+            {
+                return false;
+            }
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+wlr_output_mode* select_output_mode(wlr_output*          output,
+                                    const output_config& config)
+{
+    if (wl_list_empty(&output->modes))
+    {
+        return nullptr;
+    }
+
+    wlr_output_mode* mode;
+
+    if (config.width)
+    {
+        wlr_output_mode* best = nullptr;
+
+        wl_list_for_each(mode, &output->modes, link)
+        {
+            if (mode->width != config.width || mode->height != config.height)
+            {
+                continue;
+            }
+
+            if (!best)
+            {
+                best = mode;
+            }
+            else if (config.refresh)
+            {
+                if (std::abs(mode->refresh - config.refresh) <
+                    std::abs(best->refresh - config.refresh))
+                {
+                    best = mode;
+                }
+            }
+            else if (mode->refresh > best->refresh)
+            {
+                best = mode;
+            }
+        }
+
+        if (best)
+        {
+            return best;
+        }
+
+        wlr_log(WLR_ERROR,
+                "output %s has no %dx%d mode, using the default",
+                output->name,
+                config.width,
+                config.height);
+    }
+
+    auto* preferred = wlr_output_preferred_mode(output);
+
+    if (config.policy == mode_policy::preferred)
+    {
+        return preferred;
+    }
+
+    // panels commonly flag their 60Hz mode as preferred even when they go
+    // higher, keep the resolution and take the fastest refresh.
+    auto* best = preferred;
+
+    wl_list_for_each(mode, &output->modes, link)
+    {
+        if (mode->width == preferred->width &&
+            mode->height == preferred->height &&
+            mode->refresh > best->refresh)
+        {
+            best = mode;
+        }
+    }
+
+    return best;
+}
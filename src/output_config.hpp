@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "wlr.hpp"
+
+enum class mode_policy
+{
+    // exactly the mode the output reports as preferred
+    preferred,
+    // the preferred resolution at the highest refresh rate it is offered at
+    highest_refresh,
+};
+
+/// user configuration for a single output, matched by connector name
+struct output_config
+{
+    // connector name, "*" applies to outputs without their own entry
+    std::string name;
+
+    bool        enabled;
+    mode_policy policy;
+
+    // explicit mode, 0 width means none was requested, refresh is in mHz
+    // and 0 picks the highest refresh available for the resolution.
+    int32_t width;
+    int32_t height;
+    int32_t refresh;
+
+    // 0 keeps the scale the backend picked
+    float scale;
+
+    bool    positioned;
+    int32_t x;
+    int32_t y;
+};
+
+/// the configuration for outputs nothing else matches
+const output_config& default_output_config();
+
+/// parse TRINKSTER_OUTPUTS, entries separated by ';' look like
+/// "DP-1 mode=2560x1440@144 scale=1.5 pos=0,0" or "HDMI-A-1 off",
+/// mode also accepts "preferred" and "highest".
+std::vector<output_config> output_configs_from_env();
+bool parse_output_config(std::string_view entry, output_config& config);
+
+/// choose a mode according to config, nullptr if the output has no modes
+wlr_output_mode* select_output_mode(wlr_output*          output,
+                                    const output_config& config);
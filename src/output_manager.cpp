@@ -0,0 +1,351 @@
+#include "output_manager.hpp"
+
+#include "output.hpp"
+#include "server.hpp"
+
+namespace
+{
+/// what an output looked like before a configuration touched it
+struct saved_state
+{
+    wlr_output*         output;
+    bool                enabled;
+    wlr_output_mode*    mode;
+    int32_t             width;
+    int32_t             height;
+    int32_t             refresh;
+    wl_output_transform transform;
+    float               scale;
+};
+
+saved_state save(wlr_output* output)
+{
+    return {output,
+            output->enabled,
+            output->current_mode,
+            output->width,
+            output->height,
+            output->refresh,
+            output->transform,
+            output->scale};
+}
+
+void stage(const wlr_output_head_v1_state& state)
+{
+    auto* output = state.output;
+
+    wlr_output_enable(output, state.enabled);
+
+    if (!state.enabled)
+    {
+        return;
+    }
+
+    if (state.mode)
+    {
+        wlr_output_set_mode(output, state.mode);
+    }
+    else
+    {
+        wlr_output_set_custom_mode(output,
+                                   state.custom_mode.width,
+                                   state.custom_mode.height,
+                                   state.custom_mode.refresh);
+    }
+
+    wlr_output_set_transform(output, state.transform);
+    wlr_output_set_scale(output, state.scale);
+}
+
+void restore(const saved_state& saved)
+{
+    auto* output = saved.output;
+
+    wlr_output_enable(output, saved.enabled);
+
+    if (saved.enabled)
+    {
+        if (saved.mode)
+        {
+            wlr_output_set_mode(output, saved.mode);
+        }
+        else
+        {
+            wlr_output_set_custom_mode(
+                output, saved.width, saved.height, saved.refresh);
+        }
+
+        wlr_output_set_transform(output, saved.transform);
+        wlr_output_set_scale(output, saved.scale);
+    }
+
+    if (!wlr_output_commit(output))
+    {
+        wlr_log(WLR_ERROR, "failed to restore output %s", output->name);
+    }
+}
+
+} // namespace
+
+output_manager::output_manager(server*                    serv,
+                               wl_display*                display,
+                               std::vector<output_config> configs)
+    : server_{serv}, configs_{std::move(configs)},
+      manager_{wlr_output_manager_v1_create(display)},
+      apply_{[](auto* listener, void* data) {
+          output_manager* self = wl_container_of(listener, self, apply_);
+          auto* config = static_cast<wlr_output_configuration_v1*>(data);
+
+          if (self->apply(config, false))
+          {
+              wlr_output_configuration_v1_send_succeeded(config);
+          }
+          else
+          {
+              wlr_output_configuration_v1_send_failed(config);
+          }
+
+          wlr_output_configuration_v1_destroy(config);
+          self->publish();
+      }},
+      test_{[](auto* listener, void* data) {
+          output_manager* self = wl_container_of(listener, self, test_);
+          auto* config = static_cast<wlr_output_configuration_v1*>(data);
+
+          if (self->apply(config, true))
+          {
+              wlr_output_configuration_v1_send_succeeded(config);
+          }
+          else
+          {
+              wlr_output_configuration_v1_send_failed(config);
+          }
+
+          wlr_output_configuration_v1_destroy(config);
+      }}
+{
+    wl::connect(manager_->events.apply, apply_);
+    wl::connect(manager_->events.test, test_);
+}
+
+output_manager::~output_manager()
+{
+    apply_.remove();
+    test_.remove();
+}
+
+const output_config&
+output_manager::config_for(const wlr_output* output) const
+{
+    const output_config* fallback = &default_output_config();
+
+    for (auto&& config : configs_)
+    {
+        if (config.name == output->name)
+        {
+            return config;
+        }
+
+        if (config.name == "*")
+        {
+            fallback = &config;
+        }
+    }
+
+    return *fallback;
+}
+
+bool output_manager::configure(wlr_output* output)
+{
+    auto& config = config_for(output);
+
+    if (!config.enabled)
+    {
+        wlr_output_enable(output, false);
+        wlr_output_commit(output);
+        return false;
+    }
+
+    wlr_output_enable(output, true);
+
+    if (config.scale > 0.f)
+    {
+        wlr_output_set_scale(output, config.scale);
+    }
+
+    auto* mode = select_output_mode(output, config);
+
+    if (!mode)
+    {
+        // nested and headless backends have no modes but take any size
+        if (config.width)
+        {
+            wlr_output_set_custom_mode(
+                output, config.width, config.height, config.refresh);
+        }
+
+        return wlr_output_commit(output);
+    }
+
+    wlr_output_set_mode(output, mode);
+
+    if (wlr_output_test(output) && wlr_output_commit(output))
+    {
+        wlr_log(WLR_INFO,
+                "output %s: %dx%d@%d.%03dHz",
+                output->name,
+                mode->width,
+                mode->height,
+                mode->refresh / 1000,
+                mode->refresh % 1000);
+        return true;
+    }
+
+    wlr_log(WLR_ERROR,
+            "output %s rejected %dx%d@%dmHz, trying other modes",
+            output->name,
+            mode->width,
+            mode->height,
+            mode->refresh);
+
+    wlr_output_mode* fallback;
+    wl_list_for_each(fallback, &output->modes, link)
+    {
+        if (fallback == mode)
+        {
+            continue;
+        }
+
+        wlr_output_set_mode(output, fallback);
+
+        if (wlr_output_test(output) && wlr_output_commit(output))
+        {
+            return true;
+        }
+    }
+
+    wlr_log(WLR_ERROR, "no usable mode for output %s", output->name);
+
+    wlr_output_rollback(output);
+    wlr_output_enable(output, false);
+    wlr_output_commit(output);
+
+    return false;
+}
+
+void output_manager::publish()
+{
+    auto* config = wlr_output_configuration_v1_create();
+
+    for (auto* out : server_->outputs())
+    {
+        auto* head = wlr_output_configuration_head_v1_create(config,
+                                                             out->handle());
+        auto* box  = wlr_output_layout_get_box(server_->output_layout(),
+                                              out->handle());
+
+        if (box)
+        {
+            head->state.x = box->x;
+            head->state.y = box->y;
+        }
+    }
+
+    wlr_output_manager_v1_set_configuration(manager_, config);
+}
+
+bool output_manager::apply(wlr_output_configuration_v1* config,
+                           bool                         test_only)
+{
+    std::vector<saved_state> saved;
+
+    // stage and test every output before committing any of them, so a
+    // rejected head leaves the whole layout untouched.
+    bool ok = true;
+
+    wlr_output_configuration_head_v1* head;
+    wl_list_for_each(head, &config->heads, link)
+    {
+        saved.push_back(save(head->state.output));
+        stage(head->state);
+
+        if (!wlr_output_test(head->state.output))
+        {
+            wlr_log(WLR_ERROR,
+                    "output %s rejected the new configuration",
+                    head->state.output->name);
+            ok = false;
+            break;
+        }
+    }
+
+    if (!ok || test_only)
+    {
+        for (auto&& s : saved)
+        {
+            wlr_output_rollback(s.output);
+        }
+
+        return ok;
+    }
+
+    std::size_t committed = 0;
+    wl_list_for_each(head, &config->heads, link)
+    {
+        if (!wlr_output_commit(head->state.output))
+        {
+            ok = false;
+            break;
+        }
+
+        ++committed;
+    }
+
+    if (!ok)
+    {
+        // the test passed but a commit still failed, put back what already
+        // went through and drop what is still pending.
+        for (std::size_t i = 0; i < saved.size(); ++i)
+        {
+            if (i < committed)
+            {
+                restore(saved[i]);
+            }
+            else
+            {
+                wlr_output_rollback(saved[i].output);
+            }
+        }
+
+        return false;
+    }
+
+    auto* layout = server_->output_layout();
+
+    wl_list_for_each(head, &config->heads, link)
+    {
+        auto* output = head->state.output;
+
+        if (head->state.enabled)
+        {
+            wlr_output_layout_add(
+                layout, output, head->state.x, head->state.y);
+            static_cast<::output*>(output->data)->damage_whole();
+        }
+    }
+
+    // only once every output that stays on is laid out is it clear where
+    // the views of the disabled ones can go
+    wl_list_for_each(head, &config->heads, link)
+    {
+        auto* output = head->state.output;
+
+        if (!head->state.enabled)
+        {
+            server_->evacuate_output(*static_cast<::output*>(output->data));
+            wlr_output_layout_remove(layout, output);
+        }
+    }
+
+    return true;
+}
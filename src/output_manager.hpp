@@ -0,0 +1,44 @@
+#pragma once
+
+#include <vector>
+
+#include "output_config.hpp"
+#include "wl/listener.hpp"
+#include "wlr.hpp"
+
+class server;
+
+/// picks modes for new outputs and applies wlr-output-management requests,
+/// a request either applies to every output it names or to none of them.
+class output_manager
+{
+private:
+    server*                    server_;
+    std::vector<output_config> configs_;
+
+    wlr_output_manager_v1* manager_;
+    wl::listener           apply_;
+    wl::listener           test_;
+
+public:
+    output_manager(server*                    serv,
+                   wl_display*                display,
+                   std::vector<output_config> configs);
+    ~output_manager();
+
+    output_manager(const output_manager&) = delete;
+    output_manager& operator=(const output_manager&) = delete;
+
+    const output_config& config_for(const wlr_output* output) const;
+
+    /// enable and commit a new output with its configuration, falls back to
+    /// other modes the output offers when the chosen one is rejected.
+    /// returns whether the output ended up enabled.
+    bool configure(wlr_output* output);
+
+    /// send the current state of all outputs to management clients
+    void publish();
+
+private:
+    bool apply(wlr_output_configuration_v1* config, bool test_only);
+};
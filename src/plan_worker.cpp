@@ -0,0 +1,86 @@
+#include "plan_worker.hpp"
+
+plan_worker::plan_worker()
+    : state_{state::idle}, quit_{false}, snapshot_{nullptr}, plan_{nullptr},
+      spans_{nullptr}, thread_{[this] { run(); }}
+{}
+
+plan_worker::~plan_worker()
+{
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        quit_.store(true, std::memory_order_relaxed);
+    }
+
+    wake_.notify_one();
+    thread_.join();
+}
+
+void plan_worker::submit(const plan_snapshot&       snapshot,
+                         std::vector<render_entry>& plan,
+                         std::vector<plan_span>&    spans)
+{
+    snapshot_ = &snapshot;
+    plan_     = &plan;
+    spans_    = &spans;
+
+    state_.store(state::queued, std::memory_order_release);
+
+    // taking the lock once orders the store before the worker's check,
+    // otherwise the wakeup could slip in between check and wait.
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+    }
+    wake_.notify_one();
+}
+
+bool plan_worker::collect()
+{
+    auto current = state_.load(std::memory_order_acquire);
+
+    if (current == state::idle)
+    {
+        return false;
+    }
+
+    if (current == state::queued)
+    {
+        std::unique_lock<std::mutex> lock{mutex_};
+        finished_.wait(lock, [this] {
+            return state_.load(std::memory_order_acquire) == state::done;
+        });
+    }
+
+    state_.store(state::idle, std::memory_order_relaxed);
+
+    return true;
+}
+
+void plan_worker::run()
+{
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock{mutex_};
+            wake_.wait(lock, [this] {
+                return quit_.load(std::memory_order_relaxed) ||
+                       state_.load(std::memory_order_acquire) ==
+                           state::queued;
+            });
+
+            if (quit_.load(std::memory_order_relaxed))
+            {
+                return;
+            }
+        }
+
+        build_plan(*snapshot_, *plan_, *spans_);
+
+        state_.store(state::done, std::memory_order_release);
+
+        {
+            std::lock_guard<std::mutex> lock{mutex_};
+        }
+        finished_.notify_one();
+    }
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "render_plan.hpp"
+
+/// builds the render plans of one output on a thread of its own.
+/// the snapshot, plan and spans passed to submit() belong to the worker
+/// until collect() returns, the handoff in both directions is a single
+/// atomic state, the mutex is only there to park whichever side is idle.
+class plan_worker
+{
+private:
+    enum class state
+    {
+        idle,
+        queued,
+        done
+    };
+
+    std::atomic<state>         state_;
+    std::atomic<bool>          quit_;
+    const plan_snapshot*       snapshot_;
+    std::vector<render_entry>* plan_;
+    std::vector<plan_span>*    spans_;
+
+    std::mutex              mutex_;
+    std::condition_variable wake_;
+    std::condition_variable finished_;
+
+    std::thread thread_;
+
+public:
+    plan_worker();
+    ~plan_worker();
+
+    plan_worker(const plan_worker&) = delete;
+    plan_worker& operator=(const plan_worker&) = delete;
+
+    /// whether a plan is being built or waiting to be collected
+    bool busy() const
+    {
+        return state_.load(std::memory_order_acquire) != state::idle;
+    }
+
+    /// start building plan and spans from snapshot, only while not busy
+    void submit(const plan_snapshot&       snapshot,
+                std::vector<render_entry>& plan,
+                std::vector<plan_span>&    spans);
+
+    /// wait for the plan submitted last, false if there is none
+    bool collect();
+
+private:
+    void run();
+};
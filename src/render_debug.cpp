@@ -0,0 +1,154 @@
+#include "render_debug.hpp"
+
+#include <array>
+#include <cstdlib>
+#include <cstring>
+
+namespace
+{
+constexpr const char* mode_names[] = {"off", "damage", "overdraw"};
+
+// blue for a single layer through to red for five and more
+constexpr std::array<std::array<float, 4>, 5> heat_colors{{
+    {0.0f, 0.0f, 0.4f, 0.4f},
+    {0.0f, 0.4f, 0.0f, 0.4f},
+    {0.4f, 0.4f, 0.0f, 0.4f},
+    {0.5f, 0.25f, 0.0f, 0.4f},
+    {0.5f, 0.0f, 0.0f, 0.4f},
+}};
+
+void fill_region(wlr_renderer*      renderer,
+                 wlr_output*        output,
+                 pixman_region32_t& region,
+                 const float        color[4])
+{
+    int   nrects;
+    auto* rects = pixman_region32_rectangles(&region, &nrects);
+
+    for (int i = 0; i < nrects; ++i)
+    {
+        wlr_box box{rects[i].x1,
+                    rects[i].y1,
+                    rects[i].x2 - rects[i].x1,
+                    rects[i].y2 - rects[i].y1};
+
+        wlr_render_rect(renderer, &box, color, output->transform_matrix);
+    }
+}
+} // namespace
+
+render_debug render_debug_from_env()
+{
+    render_debug mode = render_debug::off;
+
+    if (const char* env = std::getenv("TRINKSTER_DEBUG_RENDER"))
+    {
+        parse_render_debug(env, mode);
+    }
+
+    return mode;
+}
+
+const char* render_debug_name(render_debug mode)
+{
+    return mode_names[static_cast<int>(mode)];
+}
+
+bool parse_render_debug(const char* name, render_debug& mode)
+{
+    for (int i = 0; i < 3; ++i)
+    {
+        if (std::strcmp(name, mode_names[i]) == 0)
+        {
+            mode = static_cast<render_debug>(i);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+uint64_t region_area(pixman_region32_t& region)
+{
+    int   nrects;
+    auto* rects = pixman_region32_rectangles(&region, &nrects);
+
+    uint64_t area = 0;
+    for (int i = 0; i < nrects; ++i)
+    {
+        area += static_cast<uint64_t>(rects[i].x2 - rects[i].x1) *
+                (rects[i].y2 - rects[i].y1);
+    }
+
+    return area;
+}
+
+void render_damage_overlay(wlr_renderer*      renderer,
+                           wlr_output*        output,
+                           pixman_region32_t& damage)
+{
+    const float color[4] = {0.5f, 0.0f, 0.5f, 0.3f};
+
+    fill_region(renderer, output, damage, color);
+}
+
+void render_overdraw_overlay(wlr_renderer*                    renderer,
+                             wlr_output*                      output,
+                             const std::vector<render_entry>& plan,
+                             pixman_region32_t&               damage)
+{
+    // layers[i] covers the pixels painted more than i times,
+    // the clear already accounts for layer 0 everywhere.
+    std::array<pixman_region32_t, heat_colors.size()> layers;
+
+    pixman_region32_init(&layers[0]);
+    pixman_region32_copy(&layers[0], &damage);
+    for (std::size_t i = 1; i < layers.size(); ++i)
+    {
+        pixman_region32_init(&layers[i]);
+    }
+
+    pixman_region32_t covered;
+    pixman_region32_init(&covered);
+
+    for (auto&& entry : plan)
+    {
+        if (!entry.get_texture())
+        {
+            continue;
+        }
+
+        for (std::size_t i = layers.size() - 1; i > 0; --i)
+        {
+            pixman_region32_intersect_rect(&covered,
+                                           &layers[i - 1],
+                                           entry.box.x,
+                                           entry.box.y,
+                                           entry.box.width,
+                                           entry.box.height);
+            pixman_region32_union(&layers[i], &layers[i], &covered);
+        }
+    }
+
+    for (std::size_t i = 0; i < layers.size(); ++i)
+    {
+        // only the pixels painted exactly i + 1 times,
+        // the last band takes everything above it too.
+        if (i + 1 < layers.size())
+        {
+            pixman_region32_subtract(&covered, &layers[i], &layers[i + 1]);
+        }
+        else
+        {
+            pixman_region32_copy(&covered, &layers[i]);
+        }
+
+        fill_region(renderer, output, covered, heat_colors[i].data());
+    }
+
+    pixman_region32_fini(&covered);
+    for (auto&& layer : layers)
+    {
+        pixman_region32_fini(&layer);
+    }
+}
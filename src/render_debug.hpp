@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "output.hpp"
+#include "wlr.hpp"
+
+enum class render_debug
+{
+    off,
+    damage,
+    overdraw
+};
+
+/// what a single frame actually painted
+struct render_summary
+{
+    uint32_t surfaces;
+    uint64_t pixels_drawn;
+    uint64_t pixels_output;
+};
+
+/// from TRINKSTER_DEBUG_RENDER, one of off, damage or overdraw
+render_debug render_debug_from_env();
+
+const char* render_debug_name(render_debug mode);
+
+/// leaves mode alone and returns false for an unknown name
+bool parse_render_debug(const char* name, render_debug& mode);
+
+/// number of pixels covered by the region
+uint64_t region_area(pixman_region32_t& region);
+
+/// tint every damaged rectangle of the frame
+void render_damage_overlay(wlr_renderer*      renderer,
+                           wlr_output*        output,
+                           pixman_region32_t& damage);
+
+/// colour each damaged pixel by how many times it got painted this frame,
+/// the background clear counting as the first layer.
+void render_overdraw_overlay(wlr_renderer*                    renderer,
+                             wlr_output*                      output,
+                             const std::vector<render_entry>& plan,
+                             pixman_region32_t&               damage);
@@ -0,0 +1,72 @@
+#include "render_plan.hpp"
+
+void emit_view(const plan_snapshot&       snapshot,
+               const plan_view&           v,
+               std::vector<render_entry>& plan)
+{
+    auto& target = snapshot.target;
+    auto  scale  = target.scale;
+
+    if (v.decorated && snapshot.atlas)
+    {
+        emit_decoration(plan,
+                        snapshot.atlas,
+                        snapshot.size_class,
+                        v.decoration,
+                        v.state,
+                        v.title,
+                        target);
+    }
+
+    for (std::size_t s = 0; s < v.surfaces.size(); ++s)
+    {
+        auto& surf = v.surfaces[s];
+
+        wlr_box layout{v.x + surf.box.x,
+                       v.y + surf.box.y,
+                       surf.box.width,
+                       surf.box.height};
+
+        wlr_box intersection;
+        if (!wlr_box_intersection(&intersection, &layout, &target.box))
+        {
+            continue;
+        }
+
+        render_entry entry;
+        entry.surface = surf.surface;
+        entry.texture = nullptr;
+        entry.usage   = v.usages[s];
+        entry.box     = {static_cast<int>((layout.x - target.box.x) * scale),
+                     static_cast<int>((layout.y - target.box.y) * scale),
+                     static_cast<int>(layout.width * scale),
+                     static_cast<int>(layout.height * scale)};
+        entry.source  = surf.source;
+
+        auto transform = wlr_output_transform_invert(surf.transform);
+        wlr_matrix_project_box(
+            entry.matrix, &entry.box, transform, 0, target.transform_matrix);
+
+        plan.push_back(entry);
+    }
+}
+
+void build_plan(const plan_snapshot&       snapshot,
+                std::vector<render_entry>& plan,
+                std::vector<plan_span>&    spans)
+{
+    plan.clear();
+    spans.clear();
+
+    if (!snapshot.placed)
+    {
+        return;
+    }
+
+    for (std::size_t i = 0; i < snapshot.count; ++i)
+    {
+        auto begin = plan.size();
+        emit_view(snapshot, snapshot.views[i], plan);
+        spans.push_back({begin, plan.size() - begin});
+    }
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "decoration_atlas.hpp"
+#include "view.hpp"
+#include "wlr.hpp"
+
+struct client_usage;
+
+/// a single surface draw, already projected for the output.
+/// decorations have no surface and sample texture instead.
+struct render_entry
+{
+    wlr_surface*  surface;
+    wlr_texture*  texture;
+    client_usage* usage;
+    wlr_box       box;
+    wlr_fbox      source;
+    float         matrix[9];
+
+    wlr_texture* get_texture() const
+    {
+        return surface ? wlr_surface_get_texture(surface) : texture;
+    }
+};
+
+/// an output as far as building its render plan is concerned
+struct plan_target
+{
+    // the output's box in layout coordinates
+    wlr_box box;
+    float   scale;
+    float   transform_matrix[9];
+};
+
+/// what a render plan needs of a view, copied out on the main thread
+struct plan_view
+{
+    // the view this was captured from, only ever compared against
+    const view* source;
+    uint64_t    stacking;
+
+    int x, y;
+
+    std::vector<view_surface> surfaces;
+    // one per surface
+    std::vector<client_usage*> usages;
+
+    bool              decorated;
+    decoration_layout decoration;
+    decoration_state  state;
+    std::string       title;
+};
+
+/// everything a render plan is built from. building one reads nothing but
+/// the snapshot, no live compositor state.
+struct plan_snapshot
+{
+    // false if the output isn't part of the layout, the plan is empty then
+    bool        placed;
+    plan_target target;
+
+    // decoration atlas for the output's size class, already rasterized
+    wlr_texture* atlas;
+    int          size_class;
+
+    // views touching the output bottom to top, only the first count are
+    // current. the rest are kept around so their buffers get reused.
+    std::vector<plan_view> views;
+    std::size_t            count;
+};
+
+/// where the draws of one snapshot view sit in a plan
+struct plan_span
+{
+    std::size_t begin;
+    std::size_t count;
+};
+
+/// append the draws of v, one of snapshot's views, to plan
+void emit_view(const plan_snapshot&       snapshot,
+               const plan_view&           v,
+               std::vector<render_entry>& plan);
+
+/// replace plan with the draws for snapshot, bottom to top, and spans with
+/// one span per view of it
+void build_plan(const plan_snapshot&       snapshot,
+                std::vector<render_entry>& plan,
+                std::vector<plan_span>&    spans);
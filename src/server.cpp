@@ -1,24 +1,80 @@
 #include "server.hpp"
 
 #include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <stdexcept>
+#include <string>
 
 #include <ws/ext/wl.hpp>
 
+#include "client_tracker.hpp"
+#include "ipc.hpp"
 #include "keyboard.hpp"
 #include "output.hpp"
+#include "output_manager.hpp"
 #include "view.hpp"
+#include "viewporter.hpp"
+#include "workspace.hpp"
+
+/// dispatch time an iteration may take before it counts as an overrun
+static uint64_t loop_budget_from_env()
+{
+    const char* env = std::getenv("TRINKSTER_LOOP_BUDGET_US");
+
+    if (env)
+    {
+        return std::strtoull(env, nullptr, 10) * 1000;
+    }
+
+    return 4000000;
+}
+
+static bool parallel_outputs_from_env()
+{
+    const char* env = std::getenv("TRINKSTER_PARALLEL_OUTPUTS");
+
+    return env && std::strcmp(env, "0") != 0;
+}
+
+/// the toplevel at the root of a popup chain, nullptr if there is none
+static wlr_xdg_surface* toplevel_of(wlr_xdg_surface* xdg_surface)
+{
+    while (xdg_surface && xdg_surface->role == WLR_XDG_SURFACE_ROLE_POPUP)
+    {
+        auto* parent = xdg_surface->popup->parent;
+
+        xdg_surface = parent && wlr_surface_is_xdg_surface(parent)
+                          ? wlr_xdg_surface_from_wlr_surface(parent)
+                          : nullptr;
+    }
+
+    return xdg_surface;
+}
 
 server::server(wl_display* dpy)
-    : display_{dpy}, backend_{wlr_backend_autocreate(display_, nullptr)},
+    : display_{dpy}, loop_{dpy, loop_budget_from_env()},
+      backend_{wlr_backend_autocreate(display_, nullptr)},
       renderer_{wlr_backend_get_renderer(backend_)},
+      compositor_{nullptr},
 
       xdg_shell_{wlr_xdg_shell_create(display_)},
       new_xdg_surface_{[](auto& slot, wlr_xdg_surface& xdg_surface) {
           auto& this_ = WS_CONTAINER_OF(slot, server, new_xdg_surface_);
 
+          if (xdg_surface.role == WLR_XDG_SURFACE_ROLE_POPUP)
+          {
+              // popups render and take input as part of their toplevel
+              if (auto* v = this_.view_for(toplevel_of(&xdg_surface)))
+              {
+                  v->add_popup(&xdg_surface);
+              }
+              return;
+          }
+
           if (xdg_surface.role != WLR_XDG_SURFACE_ROLE_TOPLEVEL)
           {
-              // don't care about popups
               return;
           }
 
@@ -38,17 +94,39 @@ server::server(wl_display* dpy)
                   return v->xdg_surface() == &xdg_surface;
               });
 
+          this_.release_grab(**it);
           views.erase(it);
       }},
+      next_view_id_{1}, next_stacking_{0}, visible_dirty_{true},
       cursor_{wlr_cursor_create()},
       cursor_mgr_{wlr_xcursor_manager_create(nullptr, 24)},
-      seat_{wlr_seat_create(display_, "seat0")}, output_layout_{
-                                                     wlr_output_layout_create()}
+      cursor_image_{nullptr},
+      seat_{wlr_seat_create(display_, "seat0")},
+      cursor_mode_{cursor_mode::passthrough}, grabbed_view_{nullptr},
+      output_layout_{wlr_output_layout_create()},
+      layout_change_{[](auto* listener, void*) {
+          server* self = wl_container_of(listener, self, layout_change_);
+          self->invalidate_visible_views();
+          self->invalidate_render_plans();
+          self->output_manager_->publish();
+      }},
+      input_stats_{}, render_debug_{render_debug_from_env()},
+      parallel_outputs_{parallel_outputs_from_env()}
 {
     wlr_renderer_init_wl_display(renderer_, display_);
 
-    wlr_compositor_create(display_, renderer_);
+    compositor_ = wlr_compositor_create(display_, renderer_);
+    clients_    = std::make_unique<client_tracker>(
+        this, display_, compositor_, client_tracker::policy_from_env());
+    viewporter_ = std::make_unique<viewporter>(display_);
+    decorations_ = std::make_unique<decoration_manager>(this, display_);
+    atlas_       = std::make_unique<decoration_atlas>(renderer_);
     wlr_data_device_manager_create(display_);
+    wlr_screencopy_manager_v1_create(display_);
+    output_manager_ = std::make_unique<output_manager>(
+        this, display_, output_configs_from_env());
+
+    wl::connect(output_layout_->events.change, layout_change_);
 
     new_output_.notify = handle_new_output;
     wl_signal_add(&backend_->events.new_output, &new_output_);
@@ -81,6 +159,16 @@ server::server(wl_display* dpy)
         throw std::runtime_error{"failed to add socket for display"};
     }
 
+    try
+    {
+        ipc_ = std::make_unique<ipc_server>(
+            this, wl_display_get_event_loop(display_), socket);
+    }
+    catch (const std::runtime_error& e)
+    {
+        wlr_log(WLR_ERROR, "running without ipc: %s", e.what());
+    }
+
     if (!wlr_backend_start(backend_))
     {
         throw std::runtime_error{"failed to start backend"};
@@ -88,12 +176,108 @@ server::server(wl_display* dpy)
 
     setenv("WAYLAND_DISPLAY", socket, true);
 
+    if (parallel_outputs_)
+    {
+        wlr_log(WLR_INFO, "Building render plans on a thread per output");
+    }
+
     wlr_log(WLR_INFO, "Running Trinkster on WAYLAND_DISPLAY=%s", socket);
 }
 
+server::~server()
+{
+    views_.clear();
+    clients_.reset();
+}
+
+void server::invalidate_render_plans()
+{
+    for (auto* out : outputs_)
+    {
+        out->invalidate();
+    }
+}
+
+void server::prepare_plans(output& current)
+{
+    for (auto* out : outputs_)
+    {
+        if (out != &current)
+        {
+            out->prepare_plan();
+        }
+    }
+}
+
+void server::invalidate_view_plans(view& v, const wlr_box& before)
+{
+    auto after = v.bounds();
+
+    for (auto* out : outputs_)
+    {
+        if (out->touches(before) || out->touches(after))
+        {
+            out->invalidate_view(v);
+        }
+    }
+}
+
+void server::forget_view(view& v)
+{
+    for (auto* out : outputs_)
+    {
+        out->forget_view(v);
+    }
+}
+
 void server::run()
 {
-    wl_display_run(display_);
+    loop_.run();
+}
+
+void server::terminate()
+{
+    loop_.stop();
+    wl_display_terminate(display_);
+}
+
+void server::set_render_debug_mode(render_debug mode)
+{
+    render_debug_ = mode;
+
+    for (auto* out : outputs_)
+    {
+        out->damage_whole();
+    }
+
+    wlr_log(WLR_INFO, "render debug mode: %s", render_debug_name(mode));
+}
+
+void server::damage_box(const wlr_box& box)
+{
+    for (auto* out : outputs_)
+    {
+        out->damage_box(box);
+    }
+}
+
+void server::damage_surface(wlr_surface* surface, int lx, int ly)
+{
+    for (auto* out : outputs_)
+    {
+        out->damage_surface(surface, lx, ly);
+    }
+}
+
+void server::set_cursor_image(const char* name)
+{
+    if (cursor_image_ && std::strcmp(cursor_image_, name) == 0)
+    {
+        return;
+    }
+
+    cursor_image_ = name;
+    wlr_xcursor_manager_set_cursor_image(cursor_mgr_, name, cursor_);
 }
 
 void server::add_keyboard(wlr_input_device* device)
@@ -107,28 +291,310 @@ void server::add_pointer(wlr_input_device* device)
     wlr_cursor_attach_input_device(cursor_, device);
 }
 
+output* server::output_at(double lx, double ly)
+{
+    auto* wlr_output = wlr_output_layout_output_at(output_layout_, lx, ly);
+
+    return wlr_output ? static_cast<output*>(wlr_output->data) : nullptr;
+}
+
+view* server::focused_view()
+{
+    auto* focused = seat_->keyboard_state.focused_surface;
+
+    if (!focused)
+    {
+        return nullptr;
+    }
+
+    auto it = std::find_if(std::begin(views_), std::end(views_), [&](auto&& v) {
+        return v->xdg_surface()->surface == focused;
+    });
+
+    return it != std::end(views_) ? it->get() : nullptr;
+}
+
+view* server::view_for(wlr_xdg_surface* xdg_surface)
+{
+    auto it = std::find_if(std::begin(views_), std::end(views_), [&](auto&& v) {
+        return v->xdg_surface() == xdg_surface;
+    });
+
+    return it != std::end(views_) ? it->get() : nullptr;
+}
+
+void server::place_view(view& v)
+{
+    auto* out = output_at(cursor_->x, cursor_->y);
+
+    if (!out)
+    {
+        auto it = std::find_if(std::begin(outputs_),
+                               std::end(outputs_),
+                               [](auto* o) { return o->enabled(); });
+
+        out = it != std::end(outputs_) ? *it : nullptr;
+    }
+
+    if (!out)
+    {
+        return;
+    }
+
+    if (auto* box = wlr_output_layout_get_box(output_layout_, out->handle()))
+    {
+        wlr_box geo;
+        wlr_xdg_surface_get_geometry(v.xdg_surface(), &geo);
+
+        // centre what ends up on screen, title bar included, but keep the
+        // top left corner on the output if the view is bigger than it
+        wlr_box content{0, 0, geo.width, geo.height};
+        wlr_box bounds  = v.server_side_decorated()
+                             ? decoration_layout::around(content).bounds
+                             : content;
+
+        int left = box->x + std::max(0, (box->width - bounds.width) / 2);
+        int top  = box->y + std::max(0, (box->height - bounds.height) / 2);
+
+        v.x = left - bounds.x - geo.x;
+        v.y = top - bounds.y - geo.y;
+    }
+
+    v.set_workspace(&out->active_workspace());
+}
+
+void server::evacuate_output(output& from)
+{
+    output*  to     = nullptr;
+    wlr_box* to_box = nullptr;
+
+    for (auto* out : outputs_)
+    {
+        if (out == &from || !out->enabled())
+        {
+            continue;
+        }
+
+        if ((to_box = wlr_output_layout_get_box(output_layout_, out->handle())))
+        {
+            to = out;
+            break;
+        }
+    }
+
+    if (!to)
+    {
+        wlr_log(WLR_ERROR,
+                "no output left to take the views of %s",
+                from.handle()->name);
+        return;
+    }
+
+    auto* from_box = wlr_output_layout_get_box(output_layout_, from.handle());
+
+    for (std::size_t i = 0; i < output::workspace_count; ++i)
+    {
+        auto& views = from.get_workspace(i).views();
+
+        // bottom first so they keep their order on top of the new workspace,
+        // set_workspace takes each off this list
+        while (!views.empty())
+        {
+            auto* v = views.back();
+
+            if (from_box && from_box->width > 0 && from_box->height > 0)
+            {
+                v->move(to_box->x + (v->x - from_box->x) * to_box->width /
+                                        from_box->width,
+                        to_box->y + (v->y - from_box->y) * to_box->height /
+                                        from_box->height);
+            }
+            else
+            {
+                v->move(to_box->x, to_box->y);
+            }
+
+            v->set_workspace(&to->get_workspace(i));
+        }
+    }
+}
+
+void server::remove_output(output& out)
+{
+    evacuate_output(out);
+
+    for (std::size_t i = 0; i < output::workspace_count; ++i)
+    {
+        auto& views = out.get_workspace(i).views();
+
+        while (!views.empty())
+        {
+            views.back()->set_workspace(nullptr);
+        }
+    }
+
+    outputs_.erase(std::find(std::begin(outputs_), std::end(outputs_), &out));
+    invalidate_visible_views();
+    delete &out;
+
+    // a disabled output isn't in the layout, whose change would publish
+    output_manager_->publish();
+}
+
+void server::switch_workspace(std::size_t index)
+{
+    if (auto* out = output_at(cursor_->x, cursor_->y))
+    {
+        out->switch_workspace(index);
+    }
+}
+
+void server::move_focused_to_workspace(std::size_t index)
+{
+    auto* v = focused_view();
+
+    if (!v || !v->assigned_workspace() ||
+        index >= output::workspace_count)
+    {
+        return;
+    }
+
+    auto* out = v->assigned_workspace()->get_output();
+    auto& ws  = out->get_workspace(index);
+
+    if (&ws == v->assigned_workspace())
+    {
+        return;
+    }
+
+    v->set_workspace(&ws);
+
+    if (ws.active())
+    {
+        return;
+    }
+
+    // the view just went out of sight, hand focus to whatever is on top
+    if (auto* next = out->active_workspace().topmost_mapped())
+    {
+        next->keyboard_focus(*next->xdg_surface()->surface);
+    }
+    else
+    {
+        wlr_xdg_toplevel_set_activated(v->xdg_surface(), false);
+        wlr_seat_keyboard_clear_focus(seat_);
+    }
+}
+
+const std::vector<view*>& server::visible_views()
+{
+    if (!visible_dirty_)
+    {
+        return visible_views_;
+    }
+
+    visible_dirty_ = false;
+    visible_views_.clear();
+
+    for (auto* out : outputs_)
+    {
+        if (!out->enabled())
+        {
+            continue;
+        }
+
+        auto& views = out->active_workspace().views();
+        visible_views_.insert(
+            std::end(visible_views_), std::begin(views), std::end(views));
+    }
+
+    std::sort(std::begin(visible_views_),
+              std::end(visible_views_),
+              [](view* a, view* b) { return a->stacking() > b->stacking(); });
+
+    return visible_views_;
+}
+
+void server::warp_cursor(double lx, double ly)
+{
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    ++input_stats_.motion;
+    wlr_cursor_warp_closest(cursor_, nullptr, lx, ly);
+    process_cursor_motion(
+        static_cast<uint32_t>(now.tv_sec * 1000 + now.tv_nsec / 1000000));
+}
+
 std::optional<std::tuple<view*, wlr_surface*, glm::dvec2>>
 server::view_at(double lx, double ly)
 {
-    for (auto&& view : views_)
+    // nothing is drawn off the outputs, so nothing is hit there either
+    if (!output_at(lx, ly))
+    {
+        return std::nullopt;
+    }
+
+    for (auto* view : visible_views())
     {
         auto surface_at_res = view->surface_at(lx, ly);
 
         if (surface_at_res)
         {
             auto [surf, pos] = *surface_at_res;
-            return std::make_tuple(view.get(), surf, pos);
+            return std::make_tuple(view, surf, pos);
+        }
+
+        // a title bar covers whatever is below it
+        if (view->decoration_at(lx, ly) != decoration_part::none)
+        {
+            return std::nullopt;
         }
     }
 
     return std::nullopt;
 }
 
+std::pair<view*, decoration_part> server::decoration_at(double lx, double ly)
+{
+    if (!output_at(lx, ly))
+    {
+        return {nullptr, decoration_part::none};
+    }
+
+    for (auto* view : visible_views())
+    {
+        if (view->surface_at(lx, ly))
+        {
+            return {nullptr, decoration_part::none};
+        }
+
+        auto part = view->decoration_at(lx, ly);
+
+        if (part != decoration_part::none)
+        {
+            return {view, part};
+        }
+    }
+
+    return {nullptr, decoration_part::none};
+}
+
+void server::release_grab(view& v)
+{
+    if (grabbed_view_ != &v)
+    {
+        return;
+    }
+
+    grabbed_view_ = nullptr;
+    cursor_mode_  = cursor_mode::passthrough;
+}
+
 void server::process_cursor_move(uint32_t time)
 {
     (void) time;
-    grabbed_view_->x = cursor_->x - grab_x_;
-    grabbed_view_->y = cursor_->y - grab_y_;
+    grabbed_view_->move(cursor_->x - grab_x_, cursor_->y - grab_y_);
 }
 
 void server::process_cursor_resize(uint32_t time)
@@ -175,8 +641,7 @@ void server::process_cursor_resize(uint32_t time)
         width += dx;
     }
 
-    view->x = x;
-    view->y = y;
+    view->move(x, y);
 
     view->set_size(width, height);
 }
@@ -201,7 +666,7 @@ void server::process_cursor_motion(uint32_t time)
     if (!view_opt)
     {
         // reset cursor image because no view under cursor
-        wlr_xcursor_manager_set_cursor_image(cursor_mgr_, "left_ptr", cursor_);
+        set_cursor_image("left_ptr");
         wlr_seat_pointer_clear_focus(seat);
         return;
     }
@@ -261,6 +726,8 @@ void server::handle_request_cursor(wl_listener* listener, void* data)
 
     if (focused_client == event->seat_client)
     {
+        // the theme image has to be set again once the client's is gone
+        self->cursor_image_ = nullptr;
         wlr_cursor_set_surface(
             self->cursor_, event->surface, event->hotspot_x, event->hotspot_y);
     }
@@ -282,6 +749,7 @@ void server::handle_cursor_motion(wl_listener* listener, void* data)
     server* self  = wl_container_of(listener, self, cursor_motion_);
     auto*   event = static_cast<wlr_event_pointer_motion*>(data);
 
+    ++self->input_stats_.motion;
     wlr_cursor_move(
         self->cursor_, event->device, event->delta_x, event->delta_y);
     self->process_cursor_motion(event->time_msec);
@@ -292,6 +760,7 @@ void server::handle_cursor_motion_absolute(wl_listener* listener, void* data)
     server* self  = wl_container_of(listener, self, cursor_motion_abs_);
     auto*   event = static_cast<wlr_event_pointer_motion_absolute*>(data);
 
+    ++self->input_stats_.motion;
     wlr_cursor_warp_absolute(self->cursor_, event->device, event->x, event->y);
     self->process_cursor_motion(event->time_msec);
 }
@@ -301,6 +770,8 @@ void server::handle_cursor_button(wl_listener* listener, void* data)
     server* self  = wl_container_of(listener, self, cursor_button_);
     auto*   event = static_cast<wlr_event_pointer_button*>(data);
 
+    ++self->input_stats_.button;
+
     wlr_seat_pointer_notify_button(
         self->seat(), event->time_msec, event->button, event->state);
 
@@ -308,6 +779,17 @@ void server::handle_cursor_button(wl_listener* listener, void* data)
 
     if (event->state == WLR_BUTTON_RELEASED)
     {
+        if (self->cursor_mode_ == cursor_mode::move && self->grabbed_view_ &&
+            self->grabbed_view_->mapped())
+        {
+            // dropped onto another output, follow it there
+            auto* out = self->output_at(self->cursor_->x, self->cursor_->y);
+            if (out)
+            {
+                self->grabbed_view_->set_workspace(&out->active_workspace());
+            }
+        }
+
         self->cursor_mode_ = cursor_mode::passthrough;
     }
     else
@@ -318,6 +800,64 @@ void server::handle_cursor_button(wl_listener* listener, void* data)
             (void) pos;
             view->keyboard_focus(*surf);
         }
+        else
+        {
+            self->press_decoration(self->cursor_->x, self->cursor_->y);
+        }
+    }
+}
+
+void server::press_decoration(double lx, double ly)
+{
+    auto [v, part] = decoration_at(lx, ly);
+
+    if (!v)
+    {
+        return;
+    }
+
+    v->keyboard_focus(*v->xdg_surface()->surface);
+
+    switch (part)
+    {
+    case decoration_part::title:
+        v->begin_interactive_move();
+        cursor_mode_  = cursor_mode::move;
+        grabbed_view_ = v;
+        break;
+    case decoration_part::close:
+        wlr_xdg_toplevel_send_close(v->xdg_surface());
+        break;
+    case decoration_part::border:
+    {
+        auto     deco  = v->decoration();
+        uint32_t edges = WLR_EDGE_NONE;
+
+        if (ly < deco.title.y)
+        {
+            edges |= WLR_EDGE_TOP;
+        }
+        else if (ly >= deco.borders[1].y)
+        {
+            edges |= WLR_EDGE_BOTTOM;
+        }
+
+        if (lx < deco.title.x)
+        {
+            edges |= WLR_EDGE_LEFT;
+        }
+        else if (lx >= deco.title.x + deco.title.width)
+        {
+            edges |= WLR_EDGE_RIGHT;
+        }
+
+        v->begin_interactive_resize(edges);
+        cursor_mode_  = cursor_mode::resize;
+        grabbed_view_ = v;
+        break;
+    }
+    case decoration_part::none:
+        break;
     }
 }
 
@@ -326,6 +866,8 @@ void server::handle_cursor_axis(wl_listener* listener, void* data)
     server* self  = wl_container_of(listener, self, cursor_axis_);
     auto*   event = static_cast<wlr_event_pointer_axis*>(data);
 
+    ++self->input_stats_.axis;
+
     wlr_seat_pointer_notify_axis(self->seat(),
                                  event->time_msec,
                                  event->orientation,
@@ -347,17 +889,49 @@ void server::handle_new_output(wl_listener* listener, void* data)
     server* self       = wl_container_of(listener, self, new_output_);
     auto*   wlr_output = static_cast<struct wlr_output*>(data);
 
-    // just pick the first mode for now
-    if (!wl_list_empty(&wlr_output->modes))
-    {
-        wlr_output_mode* mode =
-            wl_container_of(wlr_output->modes.prev, mode, link);
-        wlr_output_set_mode(wlr_output, mode);
-    }
+    bool enabled = self->output_manager_->configure(wlr_output);
 
-    auto* out = new output{self, wlr_output};
+    auto* out        = new output{self, wlr_output};
+    wlr_output->data = out;
 
     self->outputs_.push_back(out);
-    wlr_output_layout_add_auto(self->output_layout(), wlr_output);
+    self->invalidate_visible_views();
     wlr_output_create_global(wlr_output);
+
+    if (enabled)
+    {
+        auto& config = self->output_manager_->config_for(wlr_output);
+
+        if (config.positioned)
+        {
+            wlr_output_layout_add(
+                self->output_layout(), wlr_output, config.x, config.y);
+        }
+        else
+        {
+            wlr_output_layout_add_auto(self->output_layout(), wlr_output);
+        }
+
+        // views of an unplugged last output waited for this one
+        for (auto&& v : self->views_)
+        {
+            if (v->mapped() && !v->assigned_workspace())
+            {
+                self->place_view(*v);
+            }
+        }
+    }
+    else
+    {
+        // still offered to output management clients so it can be enabled
+        self->output_manager_->publish();
+    }
+
+    if (self->ipc_)
+    {
+        std::string msg = "{\"event\":\"output\",\"name\":";
+        append_json_string(msg, wlr_output->name);
+        msg += "}\n";
+        self->ipc_->broadcast(msg);
+    }
 }
\ No newline at end of file
@@ -1,34 +1,64 @@
 #pragma once
 
 #include "cursor.hpp"
+#include "decoration.hpp"
+#include "event_loop.hpp"
+#include "render_debug.hpp"
 #include "wl/listener.hpp"
 #include "wlr.hpp"
 
 #include <memory>
 #include <optional>
 #include <tuple>
+#include <utility>
 #include <vector>
 
 #include <glm/vec2.hpp>
 #include <ws/ws.hpp>
 
+class client_tracker;
+class ipc_server;
 class keyboard;
 class output;
+class output_manager;
 class view;
+class viewporter;
+
+struct input_stats
+{
+    uint64_t motion;
+    uint64_t button;
+    uint64_t axis;
+    uint64_t key;
+};
 
 class server
 {
 private:
     wl_display*   display_;
+    loop_driver   loop_;
     wlr_backend*  backend_;
     wlr_renderer* renderer_;
 
+    wlr_compositor*                 compositor_;
+    std::unique_ptr<client_tracker> clients_;
+    std::unique_ptr<viewporter>     viewporter_;
+
+    std::unique_ptr<decoration_manager> decorations_;
+    std::unique_ptr<decoration_atlas>   atlas_;
+
     wlr_xdg_shell*                   xdg_shell_;
     ws::slot<void(wlr_xdg_surface&)> new_xdg_surface_;
     // wl::listener                       new_xdg_surface_;
     ws::slot<void(wlr_xdg_surface&)> xdg_surface_destroy_;
     // wl::listener                       xdg_surface_destroy_;
     std::vector<std::unique_ptr<view>> views_;
+    uint32_t                           next_view_id_;
+    uint64_t                           next_stacking_;
+
+    // cache for visible_views, rebuilt only once it's marked stale
+    std::vector<view*> visible_views_;
+    bool               visible_dirty_;
 
     wlr_cursor*          cursor_;
     wlr_xcursor_manager* cursor_mgr_;
@@ -38,6 +68,8 @@ private:
     wl_listener          cursor_axis_;
     wl_listener          cursor_frame_;
 
+    const char*          cursor_image_;
+
     wlr_seat*              seat_;
     wl_listener            new_input_;
     wl_listener            request_cursor_;
@@ -53,11 +85,36 @@ private:
     wlr_output_layout*   output_layout_;
     std::vector<output*> outputs_;
     wl_listener          new_output_;
+    wl::listener         layout_change_;
+
+    std::unique_ptr<output_manager> output_manager_;
+
+    input_stats                 input_stats_;
+    render_debug                render_debug_;
+    bool                        parallel_outputs_;
+    std::unique_ptr<ipc_server> ipc_;
 
 public:
     server(wl_display* dpy);
+    ~server();
 
     void run();
+    void terminate();
+
+    wl_display* display() noexcept
+    {
+        return display_;
+    }
+
+    loop_driver& loop() noexcept
+    {
+        return loop_;
+    }
+
+    const loop_driver& loop() const noexcept
+    {
+        return loop_;
+    }
 
     wlr_seat* seat() noexcept
     {
@@ -69,6 +126,64 @@ public:
         return views_;
     }
 
+    uint32_t next_view_id() noexcept
+    {
+        return next_view_id_++;
+    }
+
+    /// stacking position above every view placed so far
+    uint64_t next_stacking() noexcept
+    {
+        return next_stacking_++;
+    }
+
+    /// views on the active workspace of any enabled output, topmost first.
+    /// a view shows on every output it overlaps, not just its own.
+    const std::vector<view*>& visible_views();
+
+    /// a view changed workspace or an output its workspace, visible_views
+    /// is rebuilt on its next use
+    void invalidate_visible_views() noexcept
+    {
+        visible_dirty_ = true;
+    }
+
+    auto& outputs()
+    {
+        return outputs_;
+    }
+
+    input_stats& input_counters() noexcept
+    {
+        return input_stats_;
+    }
+
+    client_tracker& clients() noexcept
+    {
+        return *clients_;
+    }
+
+    const viewporter& viewports() const noexcept
+    {
+        return *viewporter_;
+    }
+
+    const decoration_manager& decorations() const noexcept
+    {
+        return *decorations_;
+    }
+
+    decoration_atlas& atlas() noexcept
+    {
+        return *atlas_;
+    }
+
+    /// the control socket, null when it couldn't be set up
+    ipc_server* ipc() noexcept
+    {
+        return ipc_.get();
+    }
+
     wlr_output_layout* output_layout()
     {
         return output_layout_;
@@ -109,16 +224,91 @@ public:
         resize_edges_ = edges;
     }
 
+    /// drop a move or resize of v, for views going away mid-grab
+    void release_grab(view& v);
+
+    render_debug render_debug_mode() const noexcept
+    {
+        return render_debug_;
+    }
+
+    /// switch debug visualization, repaints every output
+    void set_render_debug_mode(render_debug mode);
+
+    /// whether outputs build their render plans on worker threads, from
+    /// TRINKSTER_PARALLEL_OUTPUTS
+    bool parallel_outputs() const noexcept
+    {
+        return parallel_outputs_;
+    }
+
+    /// have outputs other than current start rebuilding their stale plans
+    /// on their workers
+    void prepare_plans(output& current);
+
+    /// mark the render plan of every output as stale
+    void invalidate_render_plans();
+
+    /// have the outputs v was on or is on now redo its draws, before being
+    /// its bounds prior to the change
+    void invalidate_view_plans(view& v, const wlr_box& before);
+
+    /// drop v from every render plan, for views going away
+    void forget_view(view& v);
+
+    /// damage a box in layout coordinates on every output it touches
+    void damage_box(const wlr_box& box);
+    void damage_surface(wlr_surface* surface, int lx, int ly);
+
+    /// set a cursor image from the theme, does nothing if already shown
+    void set_cursor_image(const char* name);
+
     void add_keyboard(wlr_input_device* device);
     void add_pointer(wlr_input_device* device);
 
+    /// the output at the given layout coordinates, if any
+    output* output_at(double lx, double ly);
+
+    /// the view holding keyboard focus, if any
+    view* focused_view();
+
+    view* view_for(wlr_xdg_surface* xdg_surface);
+
+    /// put a newly mapped view on the active workspace under the cursor,
+    /// centred on that output
+    void place_view(view& v);
+
+    /// move the views of every workspace on from to the same workspace of
+    /// another enabled output, at the same relative position
+    void evacuate_output(output& from);
+
+    /// forget an output that is going away, its views move elsewhere or
+    /// wait for the next output if there is none
+    void remove_output(output& out);
+
+    /// show workspace index on the output under the cursor
+    void switch_workspace(std::size_t index);
+
+    /// send the focused view to workspace index of its output
+    void move_focused_to_workspace(std::size_t index);
+
+    /// move the pointer as a device would, for scripted input
+    void warp_cursor(double lx, double ly);
+
+    /// only considers views on active workspaces, in stacking order
     std::optional<std::tuple<view*, wlr_surface*, glm::dvec2>>
     view_at(double lx, double ly);
 
+    /// the server side decoration under a point, unless a surface covers it
+    std::pair<view*, decoration_part> decoration_at(double lx, double ly);
+
     void process_cursor_move(uint32_t time);
     void process_cursor_resize(uint32_t time);
     void process_cursor_motion(uint32_t time);
 
+    /// focus, move, resize or close a view through its decoration
+    void press_decoration(double lx, double ly);
+
     static void handle_new_input(wl_listener* listener, void* data);
     static void handle_request_cursor(wl_listener* listener, void* data);
     static void handle_cursor_motion(wl_listener* listener, void* data);
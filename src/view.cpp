@@ -1,16 +1,114 @@
 #include "view.hpp"
 
+#include <algorithm>
+#include <string>
+
+#include "ipc.hpp"
+#include "output.hpp"
 #include "server.hpp"
+#include "viewporter.hpp"
+#include "workspace.hpp"
+
+/// titles are drawn with an ASCII font, anything else shows as one '?' per
+/// character, however many bytes its UTF-8 encoding takes
+static std::string printable_title(const char* title)
+{
+    std::string out;
+
+    for (const char* p = title; p && *p; ++p)
+    {
+        auto c = static_cast<unsigned char>(*p);
+
+        if (c >= 0x80)
+        {
+            // skip the continuation bytes of the sequence
+            while ((static_cast<unsigned char>(p[1]) & 0xc0) == 0x80)
+            {
+                ++p;
+            }
+
+            out += '?';
+        }
+        else
+        {
+            out += c < ' ' || c > '~' ? '?' : *p;
+        }
+    }
+
+    return out;
+}
+
+static void broadcast_view_event(server& serv, const char* event, view& v)
+{
+    if (!serv.ipc())
+    {
+        return;
+    }
+
+    std::string msg = "{\"event\":\"";
+    msg += event;
+    msg += "\",\"id\":";
+    msg += std::to_string(v.id());
+    msg += "}\n";
+
+    serv.ipc()->broadcast(msg);
+}
+
+surface_watch::surface_watch(view*        owner,
+                             std::size_t  index,
+                             wlr_surface* surface)
+    : owner{owner}, index{index}, surface{surface},
+      commit{[](auto* listener, void*) {
+          surface_watch* self = wl_container_of(listener, self, commit);
+          self->owner->handle_commit(self->index);
+      }},
+      destroy{[](auto* listener, void*) {
+          surface_watch* self = wl_container_of(listener, self, destroy);
+          self->owner->forget_surface(self->index);
+      }}
+{}
+
+view_popup::view_popup(view* owner, wlr_xdg_surface* xdg_surface)
+    : owner{owner}, xdg_surface{xdg_surface},
+      map{[](auto* listener, void*) {
+          view_popup* self = wl_container_of(listener, self, map);
+          self->owner->update_surfaces();
+      }},
+      unmap{[](auto* listener, void*) {
+          view_popup* self = wl_container_of(listener, self, unmap);
+          self->owner->update_surfaces();
+      }},
+      destroy{[](auto* listener, void*) {
+          view_popup* self = wl_container_of(listener, self, destroy);
+          self->owner->forget_popup(*self);
+      }}
+{}
 
 view::view(server* serv, wlr_xdg_surface* surface)
-    : server_{serv}, xdg_surface_{surface}, map_{[](auto* listener, void*) {
+    : server_{serv}, xdg_surface_{surface}, id_{serv->next_view_id()},
+      workspace_{nullptr}, stacking_{0},
+      map_{[](auto* listener, void*) {
           view* self    = wl_container_of(listener, self, map_);
           self->mapped_ = true;
+
+          if (!self->workspace_)
+          {
+              self->server_->place_view(*self);
+          }
+
+          self->update_surfaces();
           self->keyboard_focus(*self->xdg_surface()->surface);
+          broadcast_view_event(*self->server_, "map", *self);
       }},
       unmap_{[](auto* listener, void*) {
           view* self    = wl_container_of(listener, self, unmap_);
           self->mapped_ = false;
+          self->server_->release_grab(*self);
+
+          // the next map places it anew
+          self->set_workspace(nullptr);
+          self->update_surfaces();
+          broadcast_view_event(*self->server_, "unmap", *self);
       }},
       request_move_{[](auto* listener, void* data) {
           // TODO check if it's a user requested move
@@ -25,7 +123,19 @@ view::view(server* serv, wlr_xdg_surface* surface)
           auto* event = static_cast<wlr_xdg_toplevel_resize_event*>(data);
 
           self->begin_interactive_resize(event->edges);
-      }}
+      }},
+      set_title_{[](auto* listener, void*) {
+          view* self = wl_container_of(listener, self, set_title_);
+
+          self->title_ = printable_title(self->xdg_surface_->toplevel->title);
+
+          if (self->server_side_decorated() && self->visible())
+          {
+              self->server_->damage_box(self->decoration().title);
+              self->server_->invalidate_view_plans(*self, self->bounds());
+          }
+      }},
+      mapped_{false}, geometry_{}, decoration_box_{}, x{0}, y{0}
 {
     wl::connect(xdg_surface_->events.map, map_);
     wl::connect(xdg_surface_->events.unmap, unmap_);
@@ -34,6 +144,424 @@ view::view(server* serv, wlr_xdg_surface* surface)
 
     wl::connect(toplevel->events.request_move, request_move_);
     wl::connect(toplevel->events.request_resize, request_resize_);
+    wl::connect(toplevel->events.set_title, set_title_);
+
+    title_ = printable_title(toplevel->title);
+}
+
+view::~view()
+{
+    for (auto&& w : watches_)
+    {
+        if (w.surface)
+        {
+            w.commit.remove();
+            w.destroy.remove();
+        }
+    }
+
+    for (auto&& popup : popups_)
+    {
+        popup->map.remove();
+        popup->unmap.remove();
+        popup->destroy.remove();
+    }
+
+    if (visible() && !surfaces_.empty())
+    {
+        damage_whole();
+    }
+
+    server_->forget_view(*this);
+
+    if (workspace_)
+    {
+        workspace_->remove(this);
+        server_->invalidate_visible_views();
+    }
+}
+
+bool view::update_surfaces()
+{
+    scratch_.clear();
+
+    if (mapped_)
+    {
+        wlr_xdg_surface_for_each_surface(
+            xdg_surface_,
+            [](wlr_surface* surface, int sx, int sy, void* data) {
+                auto* self       = static_cast<view*>(data);
+                auto& viewporter = self->server_->viewports();
+
+                // configured popups are walked before they map and after
+                // they unmap, their subsurfaces have nothing to show then
+                // either.
+                if (wlr_surface_is_xdg_surface(surface))
+                {
+                    auto* xdg = wlr_xdg_surface_from_wlr_surface(surface);
+
+                    if (xdg->role == WLR_XDG_SURFACE_ROLE_POPUP &&
+                        !xdg->mapped)
+                    {
+                        return;
+                    }
+                }
+
+                view_surface surf{
+                    surface, {sx, sy, 0, 0}, surface->current.transform, {}};
+                viewporter.surface_size(
+                    surface, surf.box.width, surf.box.height);
+                viewporter.source_box(surface, surf.source);
+
+                self->scratch_.push_back(surf);
+            },
+            this);
+    }
+
+    wlr_box geometry{};
+    if (mapped_)
+    {
+        wlr_xdg_surface_get_geometry(xdg_surface_, &geometry);
+    }
+
+    bool unchanged = geometry.x == geometry_.x && geometry.y == geometry_.y &&
+                     geometry.width == geometry_.width &&
+                     geometry.height == geometry_.height &&
+                     std::equal(
+        std::begin(surfaces_),
+        std::end(surfaces_),
+        std::begin(scratch_),
+        std::end(scratch_),
+        [](const view_surface& a, const view_surface& b) {
+            return a.surface == b.surface && a.box.x == b.box.x &&
+                   a.box.y == b.box.y && a.box.width == b.box.width &&
+                   a.box.height == b.box.height &&
+                   a.transform == b.transform &&
+                   a.source.x == b.source.x && a.source.y == b.source.y &&
+                   a.source.width == b.source.width &&
+                   a.source.height == b.source.height;
+        });
+
+    if (unchanged)
+    {
+        return false;
+    }
+
+    damage_whole();
+
+    // this may run from one of the commit listeners being removed here,
+    // wlroots emits surface signals safely so that's fine.
+    for (auto&& w : watches_)
+    {
+        if (w.surface)
+        {
+            w.commit.remove();
+            w.destroy.remove();
+        }
+    }
+    watches_.clear();
+
+    auto before = bounds();
+
+    surfaces_.swap(scratch_);
+    geometry_ = geometry;
+    refresh_decoration_box();
+
+    // reserve up front, the listeners may not move until they're connected
+    watches_.reserve(surfaces_.size());
+    for (std::size_t i = 0; i < surfaces_.size(); ++i)
+    {
+        watches_.emplace_back(this, i, surfaces_[i].surface);
+    }
+
+    for (auto&& w : watches_)
+    {
+        wl::connect(w.surface->events.commit, w.commit);
+        wl::connect(w.surface->events.destroy, w.destroy);
+    }
+
+    if (visible())
+    {
+        damage_whole();
+        server_->invalidate_view_plans(*this, before);
+    }
+
+    return true;
+}
+
+void view::handle_commit(std::size_t index)
+{
+    if (update_surfaces())
+    {
+        return;
+    }
+
+    if (visible())
+    {
+        auto& surf = surfaces_[index];
+        server_->damage_surface(surf.surface, x + surf.box.x, y + surf.box.y);
+    }
+}
+
+void view::forget_surface(std::size_t index)
+{
+    auto& w    = watches_[index];
+    auto& surf = surfaces_[index];
+
+    w.commit.remove();
+    w.destroy.remove();
+    w.surface = nullptr;
+
+    auto before  = bounds();
+    surf.surface = nullptr;
+
+    if (visible())
+    {
+        server_->damage_box(
+            {x + surf.box.x, y + surf.box.y, surf.box.width, surf.box.height});
+        server_->invalidate_view_plans(*this, before);
+    }
+}
+
+void view::add_popup(wlr_xdg_surface* popup)
+{
+    auto tracked = std::make_unique<view_popup>(this, popup);
+
+    wl::connect(popup->events.map, tracked->map);
+    wl::connect(popup->events.unmap, tracked->unmap);
+    wl::connect(popup->events.destroy, tracked->destroy);
+
+    popups_.push_back(std::move(tracked));
+
+    // without a workspace yet, set_workspace takes care of it
+    unconstrain_popup(popup);
+}
+
+void view::unconstrain_popup(wlr_xdg_surface* popup)
+{
+    auto* out = workspace_ ? workspace_->get_output() : nullptr;
+    auto* box = out ? wlr_output_layout_get_box(server_->output_layout(),
+                                                out->handle())
+                    : nullptr;
+
+    if (!box)
+    {
+        return;
+    }
+
+    // wlroots wants the bounds relative to the toplevel's surface, it adds
+    // the window geometry offset itself
+    wlr_box bounds{box->x - x, box->y - y, box->width, box->height};
+    wlr_xdg_popup_unconstrain_from_box(popup->popup, &bounds);
+}
+
+void view::forget_popup(view_popup& popup)
+{
+    popup.map.remove();
+    popup.unmap.remove();
+    popup.destroy.remove();
+
+    // an unmap came first if it was mapped, the surface list is current
+    popups_.erase(std::find_if(std::begin(popups_),
+                               std::end(popups_),
+                               [&](auto&& p) { return p.get() == &popup; }));
+}
+
+void view::move(int nx, int ny)
+{
+    if (nx == x && ny == y)
+    {
+        return;
+    }
+
+    damage_whole();
+
+    auto before = bounds();
+
+    x = nx;
+    y = ny;
+
+    if (mapped_ && visible())
+    {
+        damage_whole();
+        server_->invalidate_view_plans(*this, before);
+    }
+}
+
+void view::set_workspace(workspace* ws)
+{
+    if (ws == workspace_)
+    {
+        return;
+    }
+
+    bool was_visible = visible();
+    damage_whole();
+
+    auto* old_output = workspace_ ? workspace_->get_output() : nullptr;
+
+    if (workspace_)
+    {
+        workspace_->remove(this);
+    }
+
+    workspace_ = ws;
+    server_->invalidate_visible_views();
+
+    if (workspace_)
+    {
+        stacking_ = server_->next_stacking();
+        workspace_->add(this);
+    }
+
+    if (workspace_ && workspace_->get_output() != old_output &&
+        !popups_.empty())
+    {
+        // wlroots 0.11 can't send an open popup a new configure, only its
+        // position follows the new bounds
+        for (auto&& popup : popups_)
+        {
+            unconstrain_popup(popup->xdg_surface);
+        }
+
+        if (mapped_)
+        {
+            update_surfaces();
+        }
+    }
+
+    if (was_visible || visible())
+    {
+        server_->invalidate_view_plans(*this, bounds());
+    }
+
+    damage_whole();
+}
+
+bool view::visible() const
+{
+    return workspace_ && workspace_->active();
+}
+
+wlr_box view::bounds() const
+{
+    bool empty = true;
+    int  x1 = 0, y1 = 0, x2 = 0, y2 = 0;
+
+    auto add = [&](const wlr_box& box) {
+        if (empty)
+        {
+            empty = false;
+            x1    = box.x;
+            y1 = box.y;
+            x2 = box.x + box.width;
+            y2 = box.y + box.height;
+            return;
+        }
+
+        x1 = std::min(x1, box.x);
+        y1 = std::min(y1, box.y);
+        x2 = std::max(x2, box.x + box.width);
+        y2 = std::max(y2, box.y + box.height);
+    };
+
+    if (decoration_box_.width > 0)
+    {
+        add(decoration_box_);
+    }
+
+    for (auto&& surf : surfaces_)
+    {
+        if (surf.surface && surf.box.width > 0)
+        {
+            add(surf.box);
+        }
+    }
+
+    return {x + x1, y + y1, x2 - x1, y2 - y1};
+}
+
+void view::damage_whole()
+{
+    if (!visible())
+    {
+        return;
+    }
+
+    damage_decoration();
+
+    for (auto&& surf : surfaces_)
+    {
+        if (surf.surface)
+        {
+            server_->damage_box({x + surf.box.x,
+                                 y + surf.box.y,
+                                 surf.box.width,
+                                 surf.box.height});
+        }
+    }
+}
+
+bool view::server_side_decorated() const
+{
+    return server_->decorations().server_side(xdg_surface_);
+}
+
+decoration_layout view::decoration() const
+{
+    return decoration_layout::around({x + geometry_.x,
+                                      y + geometry_.y,
+                                      geometry_.width,
+                                      geometry_.height});
+}
+
+decoration_part view::decoration_at(double lx, double ly) const
+{
+    if (decoration_box_.width == 0)
+    {
+        return decoration_part::none;
+    }
+
+    return decoration().part_at(lx, ly);
+}
+
+void view::refresh_decoration_box()
+{
+    if (mapped_ && server_side_decorated())
+    {
+        decoration_box_ = decoration().bounds;
+        decoration_box_.x -= x;
+        decoration_box_.y -= y;
+    }
+    else
+    {
+        decoration_box_ = {};
+    }
+}
+
+void view::damage_decoration()
+{
+    if (visible() && decoration_box_.width > 0)
+    {
+        server_->damage_box({x + decoration_box_.x,
+                             y + decoration_box_.y,
+                             decoration_box_.width,
+                             decoration_box_.height});
+    }
+}
+
+void view::refresh_decoration()
+{
+    auto before = bounds();
+
+    damage_decoration();
+    refresh_decoration_box();
+    damage_decoration();
+
+    if (visible())
+    {
+        server_->invalidate_view_plans(*this, before);
+    }
 }
 
 void view::keyboard_focus(wlr_surface& surf)
@@ -48,6 +576,8 @@ void view::keyboard_focus(wlr_surface& surf)
         return;
     }
 
+    auto* prev_view = server->focused_view();
+
     if (prev_surface)
     {
         auto* xdg_prev = wlr_xdg_surface_from_wlr_surface(prev_surface);
@@ -63,6 +593,17 @@ void view::keyboard_focus(wlr_surface& surf)
                                    keyboard->keycodes,
                                    keyboard->num_keycodes,
                                    &keyboard->modifiers);
+
+    // decorations are drawn per focus state
+    if (prev_view != this)
+    {
+        if (prev_view)
+        {
+            prev_view->refresh_decoration();
+        }
+
+        refresh_decoration();
+    }
 }
 
 std::optional<std::tuple<wlr_surface*, glm::dvec2>> view::surface_at(double lx,
@@ -71,13 +612,23 @@ std::optional<std::tuple<wlr_surface*, glm::dvec2>> view::surface_at(double lx,
     double view_sx = lx - x;
     double view_sy = ly - y;
 
-    double sx, sy;
-    auto*  surface =
-        wlr_xdg_surface_surface_at(xdg_surface_, view_sx, view_sy, &sx, &sy);
+    auto& viewporter = server_->viewports();
 
-    if (surface)
+    // our boxes know about viewports, wlroots' surface_at doesn't
+    for (auto it = surfaces_.rbegin(); it != surfaces_.rend(); ++it)
     {
-        return {std::make_tuple(surface, glm::dvec2{sx, sy})};
+        if (!it->surface)
+        {
+            continue;
+        }
+
+        double sx = view_sx - it->box.x;
+        double sy = view_sy - it->box.y;
+
+        if (viewporter.accepts_input(it->surface, sx, sy))
+        {
+            return {std::make_tuple(it->surface, glm::dvec2{sx, sy})};
+        }
     }
 
     return std::nullopt;
@@ -1,34 +1,110 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+#include <memory>
 #include <optional>
+#include <string>
 #include <tuple>
+#include <vector>
 
 #include <glm/vec2.hpp>
 
 #include "cursor.hpp"
+#include "decoration_atlas.hpp"
 #include "wl/listener.hpp"
 #include "wlr.hpp"
 
 class server;
+class view;
+class workspace;
+
+/// a surface of a view's surface tree, positioned relative to the view.
+/// box is sized after the surface's viewport, if it has one.
+struct view_surface
+{
+    wlr_surface*        surface;
+    wlr_box             box;
+    wl_output_transform transform;
+
+    // part of the buffer to sample in buffer pixels, 0 width for all of it
+    wlr_fbox source;
+};
+
+/// keeps a view_surface up to date with its wlr_surface
+struct surface_watch
+{
+    view*        owner;
+    std::size_t  index;
+    wlr_surface* surface;
+    wl::listener commit;
+    wl::listener destroy;
+
+    surface_watch(view* owner, std::size_t index, wlr_surface* surface);
+};
+
+/// an xdg popup anywhere below a view, its surfaces only show up in the
+/// view's surface list while it is mapped
+struct view_popup
+{
+    view*            owner;
+    wlr_xdg_surface* xdg_surface;
+    wl::listener     map;
+    wl::listener     unmap;
+    wl::listener     destroy;
+
+    view_popup(view* owner, wlr_xdg_surface* xdg_surface);
+};
 
 class view
 {
 private:
     server*          server_;
     wlr_xdg_surface* xdg_surface_;
+    uint32_t         id_;
+    workspace*       workspace_;
+    uint64_t         stacking_;
 
     wl::listener map_;
     wl::listener unmap_;
     wl::listener request_move_;
     wl::listener request_resize_;
+    wl::listener set_title_;
 
     bool mapped_;
 
+    // flattened surface tree including popups, in rendering order.
+    // hit testing walks it backwards, so popups come before their parents.
+    std::vector<view_surface>  surfaces_;
+    std::vector<view_surface>  scratch_;
+    std::vector<surface_watch> watches_;
+
+    std::vector<std::unique_ptr<view_popup>> popups_;
+
+    // window geometry as of the last surface update
+    wlr_box geometry_;
+
+    // printable part of the title, only changes with set_title
+    std::string title_;
+
+    // server side decoration bounds relative to the view, empty if the
+    // client decorates itself.
+    wlr_box decoration_box_;
+
 public:
     int x, y;
 
 public:
     view(server* serv, wlr_xdg_surface* surface);
+    ~view();
+
+    view(const view&) = delete;
+    view& operator=(const view&) = delete;
+
+    uint32_t id() const
+    {
+        return id_;
+    }
 
     bool mapped() const
     {
@@ -40,6 +116,73 @@ public:
         return xdg_surface_;
     }
 
+    workspace* assigned_workspace() const
+    {
+        return workspace_;
+    }
+
+    /// move the view onto another workspace, nullptr to take it off all.
+    /// it goes on top of everything there.
+    void set_workspace(workspace* ws);
+
+    /// position in the stacking order across outputs, higher is on top
+    uint64_t stacking() const
+    {
+        return stacking_;
+    }
+
+    /// whether the view sits on an active workspace
+    bool visible() const;
+
+    const std::vector<view_surface>& surfaces() const
+    {
+        return surfaces_;
+    }
+
+    /// walk the surface tree and refresh the cached surface list, render
+    /// plans are only invalidated if the layout actually changed.
+    /// returns whether it did change.
+    bool update_surfaces();
+
+    void handle_commit(std::size_t index);
+
+    /// stop tracking a surface which is being destroyed
+    void forget_surface(std::size_t index);
+
+    /// track a popup of this view or of one of its popups, and keep it on
+    /// the output the view is on as far as its positioner allows. popups
+    /// follow the view when it moves to another output.
+    void add_popup(wlr_xdg_surface* popup);
+
+    /// stop tracking a popup which is being destroyed
+    void forget_popup(view_popup& popup);
+
+    void move(int nx, int ny);
+
+    /// everything the view draws, decoration included, in layout
+    /// coordinates
+    wlr_box bounds() const;
+
+    /// damage every surface of the view on all outputs
+    void damage_whole();
+
+    const std::string& title() const
+    {
+        return title_;
+    }
+
+    bool server_side_decorated() const;
+
+    /// server side decoration around the window geometry
+    decoration_layout decoration() const;
+
+    /// part of the server side decoration under a point in layout
+    /// coordinates, none if the view isn't decorated by us.
+    decoration_part decoration_at(double lx, double ly) const;
+
+    /// pick up a new decoration mode or focus state
+    void refresh_decoration();
+
     void keyboard_focus(wlr_surface& surf);
 
     /// given 2 coordinates in layout space
@@ -57,4 +200,11 @@ public:
     void begin_interactive_resize(uint32_t edges);
 
     void set_size(uint32_t width, uint32_t height);
+
+private:
+    void refresh_decoration_box();
+    void damage_decoration();
+
+    /// keep a popup on the output of the view's workspace, if it has one
+    void unconstrain_popup(wlr_xdg_surface* popup);
 };
\ No newline at end of file
@@ -0,0 +1,438 @@
+#include "viewporter.hpp"
+
+#include <cmath>
+#include <stdexcept>
+
+#include "viewporter-protocol.h"
+
+namespace
+{
+constexpr int viewporter_version = 1;
+
+surface_viewport* from_resource(wl_resource* resource)
+{
+    return static_cast<surface_viewport*>(wl_resource_get_user_data(resource));
+}
+
+void handle_destroy(wl_client* client, wl_resource* resource)
+{
+    (void) client;
+    wl_resource_destroy(resource);
+}
+
+void handle_set_source(wl_client*   client,
+                       wl_resource* resource,
+                       wl_fixed_t   x,
+                       wl_fixed_t   y,
+                       wl_fixed_t   width,
+                       wl_fixed_t   height)
+{
+    (void) client;
+    auto* vp = from_resource(resource);
+
+    if (!vp)
+    {
+        wl_resource_post_error(resource,
+                               WP_VIEWPORT_ERROR_NO_SURFACE,
+                               "wl_surface was destroyed");
+        return;
+    }
+
+    wlr_fbox src{wl_fixed_to_double(x),
+                 wl_fixed_to_double(y),
+                 wl_fixed_to_double(width),
+                 wl_fixed_to_double(height)};
+
+    if (src.x == -1.0 && src.y == -1.0 && src.width == -1.0 &&
+        src.height == -1.0)
+    {
+        vp->pending_src = {0, 0, -1, -1};
+        return;
+    }
+
+    if (src.x < 0 || src.y < 0 || src.width <= 0 || src.height <= 0)
+    {
+        wl_resource_post_error(resource,
+                               WP_VIEWPORT_ERROR_BAD_VALUE,
+                               "invalid source rectangle");
+        return;
+    }
+
+    vp->pending_src = src;
+}
+
+void handle_set_destination(wl_client*   client,
+                            wl_resource* resource,
+                            int32_t      width,
+                            int32_t      height)
+{
+    (void) client;
+    auto* vp = from_resource(resource);
+
+    if (!vp)
+    {
+        wl_resource_post_error(resource,
+                               WP_VIEWPORT_ERROR_NO_SURFACE,
+                               "wl_surface was destroyed");
+        return;
+    }
+
+    if (width == -1 && height == -1)
+    {
+        vp->pending_width  = -1;
+        vp->pending_height = -1;
+        return;
+    }
+
+    if (width <= 0 || height <= 0)
+    {
+        wl_resource_post_error(resource,
+                               WP_VIEWPORT_ERROR_BAD_VALUE,
+                               "invalid destination size");
+        return;
+    }
+
+    vp->pending_width  = width;
+    vp->pending_height = height;
+}
+
+void handle_resource_destroy(wl_resource* resource)
+{
+    auto* vp = from_resource(resource);
+
+    if (!vp)
+    {
+        return;
+    }
+
+    // the crop and scale go away with the next commit, like any other
+    // double buffered state.
+    vp->resource       = nullptr;
+    vp->pending_src    = {0, 0, -1, -1};
+    vp->pending_width  = -1;
+    vp->pending_height = -1;
+}
+
+const struct wp_viewport_interface viewport_impl = {
+    handle_destroy,
+    handle_set_source,
+    handle_set_destination,
+};
+
+/// wlr_fbox_transform from later wlroots releases
+void fbox_transform(wlr_fbox&           box,
+                    wl_output_transform transform,
+                    double              width,
+                    double              height)
+{
+    wlr_fbox src = box;
+
+    if (transform % 2 != 0)
+    {
+        box.width  = src.height;
+        box.height = src.width;
+    }
+
+    switch (transform)
+    {
+    case WL_OUTPUT_TRANSFORM_NORMAL:
+        break;
+    case WL_OUTPUT_TRANSFORM_90:
+        box.x = height - src.y - src.height;
+        box.y = src.x;
+        break;
+    case WL_OUTPUT_TRANSFORM_180:
+        box.x = width - src.x - src.width;
+        box.y = height - src.y - src.height;
+        break;
+    case WL_OUTPUT_TRANSFORM_270:
+        box.x = src.y;
+        box.y = width - src.x - src.width;
+        break;
+    case WL_OUTPUT_TRANSFORM_FLIPPED:
+        box.x = width - src.x - src.width;
+        break;
+    case WL_OUTPUT_TRANSFORM_FLIPPED_90:
+        box.x = src.y;
+        box.y = src.x;
+        break;
+    case WL_OUTPUT_TRANSFORM_FLIPPED_180:
+        box.y = height - src.y - src.height;
+        break;
+    case WL_OUTPUT_TRANSFORM_FLIPPED_270:
+        box.x = height - src.y - src.height;
+        box.y = width - src.x - src.width;
+        break;
+    }
+}
+} // namespace
+
+surface_viewport::surface_viewport(viewporter*  owner,
+                                   wl_resource* resource,
+                                   wlr_surface* surface)
+    : owner{owner}, resource{resource}, surface{surface},
+      pending_src{0, 0, -1, -1}, src{0, 0, -1, -1}, pending_width{-1},
+      pending_height{-1}, width{-1}, height{-1},
+      commit{[](auto* listener, void*) {
+          surface_viewport* self = wl_container_of(listener, self, commit);
+          self->owner->apply(*self);
+      }},
+      destroy{[](auto* listener, void*) {
+          surface_viewport* self = wl_container_of(listener, self, destroy);
+          self->owner->remove(*self);
+      }}
+{}
+
+viewporter::viewporter(wl_display* display)
+    : global_{wl_global_create(display,
+                               &wp_viewporter_interface,
+                               viewporter_version,
+                               this,
+                               handle_bind)}
+{
+    if (!global_)
+    {
+        throw std::runtime_error{"failed to create wp_viewporter global"};
+    }
+}
+
+viewporter::~viewporter()
+{
+    for (auto&& [surface, vp] : viewports_)
+    {
+        (void) surface;
+
+        if (vp->resource)
+        {
+            wl_resource_set_user_data(vp->resource, nullptr);
+        }
+
+        vp->commit.remove();
+        vp->destroy.remove();
+    }
+
+    wl_global_destroy(global_);
+}
+
+const surface_viewport* viewporter::find(wlr_surface* surface) const
+{
+    if (viewports_.empty())
+    {
+        return nullptr;
+    }
+
+    auto it = viewports_.find(surface);
+
+    return it != viewports_.end() ? it->second.get() : nullptr;
+}
+
+void viewporter::surface_size(wlr_surface* surface,
+                              int&         width,
+                              int&         height) const
+{
+    auto* vp = find(surface);
+
+    if (vp && vp->has_dst())
+    {
+        width  = vp->width;
+        height = vp->height;
+    }
+    else if (vp && vp->has_src())
+    {
+        width  = static_cast<int>(vp->src.width);
+        height = static_cast<int>(vp->src.height);
+    }
+    else
+    {
+        width  = surface->current.width;
+        height = surface->current.height;
+    }
+}
+
+bool viewporter::source_box(wlr_surface* surface, wlr_fbox& box) const
+{
+    auto* vp = find(surface);
+
+    if (!vp || !vp->has_src())
+    {
+        return false;
+    }
+
+    auto& state = surface->current;
+    auto  scale = state.scale;
+
+    box = {vp->src.x * scale,
+           vp->src.y * scale,
+           vp->src.width * scale,
+           vp->src.height * scale};
+
+    // the source is in surface coordinates, undo the buffer transform
+    if (state.transform % 2 != 0)
+    {
+        fbox_transform(box,
+                       wlr_output_transform_invert(state.transform),
+                       state.buffer_height,
+                       state.buffer_width);
+    }
+    else
+    {
+        fbox_transform(box,
+                       wlr_output_transform_invert(state.transform),
+                       state.buffer_width,
+                       state.buffer_height);
+    }
+
+    return true;
+}
+
+bool viewporter::accepts_input(wlr_surface* surface,
+                               double       sx,
+                               double       sy) const
+{
+    auto* vp = find(surface);
+
+    if (!vp)
+    {
+        return wlr_surface_point_accepts_input(surface, sx, sy);
+    }
+
+    // wlroots clips the input region to the unscaled size, clip it to the
+    // destination instead.
+    int width, height;
+    surface_size(surface, width, height);
+
+    return sx >= 0 && sy >= 0 && sx < width && sy < height &&
+           pixman_region32_contains_point(&surface->current.input,
+                                          static_cast<int>(std::floor(sx)),
+                                          static_cast<int>(std::floor(sy)),
+                                          nullptr);
+}
+
+void viewporter::handle_bind(wl_client* client,
+                             void*      data,
+                             uint32_t   version,
+                             uint32_t   id)
+{
+    static const struct wp_viewporter_interface impl = {
+        handle_destroy,
+        handle_get_viewport,
+    };
+
+    auto* resource =
+        wl_resource_create(client, &wp_viewporter_interface, version, id);
+
+    if (!resource)
+    {
+        wl_client_post_no_memory(client);
+        return;
+    }
+
+    wl_resource_set_implementation(resource, &impl, data, nullptr);
+}
+
+void viewporter::handle_get_viewport(wl_client*   client,
+                                     wl_resource* resource,
+                                     uint32_t     id,
+                                     wl_resource* surface_resource)
+{
+    auto* self =
+        static_cast<viewporter*>(wl_resource_get_user_data(resource));
+    auto* surface = wlr_surface_from_resource(surface_resource);
+
+    auto it = self->viewports_.find(surface);
+
+    // a viewport whose resource is gone but hasn't been committed away
+    // yet doesn't count.
+    if (it != self->viewports_.end() && it->second->resource)
+    {
+        wl_resource_post_error(resource,
+                               WP_VIEWPORTER_ERROR_VIEWPORT_EXISTS,
+                               "surface already has a viewport");
+        return;
+    }
+
+    auto* vp_resource = wl_resource_create(client,
+                                           &wp_viewport_interface,
+                                           wl_resource_get_version(resource),
+                                           id);
+
+    if (!vp_resource)
+    {
+        wl_client_post_no_memory(client);
+        return;
+    }
+
+    if (it != self->viewports_.end())
+    {
+        // reuse it, the current crop and scale stay until the next commit
+        auto& vp          = *it->second;
+        vp.resource       = vp_resource;
+        vp.pending_src    = vp.src;
+        vp.pending_width  = vp.width;
+        vp.pending_height = vp.height;
+
+        wl_resource_set_implementation(
+            vp_resource, &viewport_impl, &vp, handle_resource_destroy);
+        return;
+    }
+
+    auto vp = std::make_unique<surface_viewport>(self, vp_resource, surface);
+
+    wl_resource_set_implementation(
+        vp_resource, &viewport_impl, vp.get(), handle_resource_destroy);
+
+    // the viewport has to be current before anyone else looks at the
+    // commit, views size their surfaces from it.
+    wl::connect_first(surface->events.commit, vp->commit);
+    wl::connect(surface->events.destroy, vp->destroy);
+
+    self->viewports_.emplace(surface, std::move(vp));
+}
+
+void viewporter::apply(surface_viewport& vp)
+{
+    vp.src    = vp.pending_src;
+    vp.width  = vp.pending_width;
+    vp.height = vp.pending_height;
+
+    if (!vp.resource)
+    {
+        remove(vp);
+        return;
+    }
+
+    if (!vp.has_dst() && vp.has_src() &&
+        (vp.src.width != std::floor(vp.src.width) ||
+         vp.src.height != std::floor(vp.src.height)))
+    {
+        wl_resource_post_error(vp.resource,
+                               WP_VIEWPORT_ERROR_BAD_SIZE,
+                               "source size is not integer");
+        return;
+    }
+
+    auto* surface = vp.surface;
+
+    if (vp.has_src() && wlr_surface_has_buffer(surface) &&
+        (vp.src.x + vp.src.width > surface->current.width ||
+         vp.src.y + vp.src.height > surface->current.height))
+    {
+        wl_resource_post_error(vp.resource,
+                               WP_VIEWPORT_ERROR_OUT_OF_BUFFER,
+                               "source rectangle extends outside of the "
+                               "content area");
+    }
+}
+
+void viewporter::remove(surface_viewport& vp)
+{
+    if (vp.resource)
+    {
+        wl_resource_set_user_data(vp.resource, nullptr);
+    }
+
+    vp.commit.remove();
+    vp.destroy.remove();
+
+    viewports_.erase(vp.surface);
+}
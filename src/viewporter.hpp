@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+
+#include "wl/listener.hpp"
+#include "wlr.hpp"
+
+class viewporter;
+
+/// crop and scale state a client attached to one of its surfaces
+struct surface_viewport
+{
+    viewporter*  owner;
+    wl_resource* resource;
+    wlr_surface* surface;
+
+    // source rectangle in surface coordinates, negative width when unset
+    wlr_fbox pending_src;
+    wlr_fbox src;
+
+    // destination size in surface coordinates, -1 when unset
+    int32_t pending_width;
+    int32_t pending_height;
+    int32_t width;
+    int32_t height;
+
+    wl::listener commit;
+    wl::listener destroy;
+
+    surface_viewport(viewporter*  owner,
+                     wl_resource* resource,
+                     wlr_surface* surface);
+
+    bool has_src() const
+    {
+        return src.width >= 0;
+    }
+
+    bool has_dst() const
+    {
+        return width > 0;
+    }
+};
+
+/// wp_viewporter, lets clients submit buffers at any size and have them
+/// cropped and scaled by the compositor instead.
+class viewporter
+{
+    friend struct surface_viewport;
+
+private:
+    wl_global* global_;
+
+    std::unordered_map<wlr_surface*, std::unique_ptr<surface_viewport>>
+        viewports_;
+
+public:
+    viewporter(wl_display* display);
+    ~viewporter();
+
+    viewporter(const viewporter&) = delete;
+    viewporter& operator=(const viewporter&) = delete;
+
+    const surface_viewport* find(wlr_surface* surface) const;
+
+    /// size of the surface in surface coordinates once scaled
+    void surface_size(wlr_surface* surface, int& width, int& height) const;
+
+    /// the part of the buffer to sample in buffer pixels, false if the
+    /// whole buffer is used.
+    bool source_box(wlr_surface* surface, wlr_fbox& box) const;
+
+    /// whether the point in surface coordinates is in the input region
+    bool accepts_input(wlr_surface* surface, double sx, double sy) const;
+
+private:
+    static void handle_bind(wl_client* client,
+                            void*      data,
+                            uint32_t   version,
+                            uint32_t   id);
+    static void handle_get_viewport(wl_client*   client,
+                                    wl_resource* resource,
+                                    uint32_t     id,
+                                    wl_resource* surface_resource);
+
+    void apply(surface_viewport& vp);
+    void remove(surface_viewport& vp);
+};
@@ -12,6 +12,11 @@ void connect(wl_signal& s, wl::listener& l) noexcept
     wl_list_insert(s.listener_list.prev, &l.link);
 }
 
+void connect_first(wl_signal& s, wl::listener& l) noexcept
+{
+    wl_list_insert(&s.listener_list, &l.link);
+}
+
 listener::listener(listener&& other) noexcept : wl_listener{other}
 {
     // we need to set these again for our surrounding as we just moved
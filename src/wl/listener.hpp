@@ -8,6 +8,7 @@ class listener : public wl_listener
 {
 public:
     friend void connect(wl_signal&, wl::listener&) noexcept;
+    friend void connect_first(wl_signal&, wl::listener&) noexcept;
 
 public:
     listener(wl_notify_func_t fn) noexcept : wl_listener{{}, fn}
@@ -27,4 +28,7 @@ public:
 void connect(wl_signal&, wl_listener&) noexcept;
 void connect(wl_signal&, wl::listener&) noexcept;
 
+/// connect ahead of every listener already on the signal
+void connect_first(wl_signal&, wl::listener&) noexcept;
+
 } // namespace wl
\ No newline at end of file
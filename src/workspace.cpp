@@ -0,0 +1,35 @@
+#include "workspace.hpp"
+
+#include <algorithm>
+
+#include "output.hpp"
+#include "view.hpp"
+
+workspace::workspace(output* out, std::size_t index)
+    : output_{out}, index_{index}
+{}
+
+bool workspace::active() const
+{
+    return &output_->active_workspace() == this;
+}
+
+view* workspace::topmost_mapped() const
+{
+    auto it = std::find_if(std::begin(views_),
+                           std::end(views_),
+                           [](view* v) { return v->mapped(); });
+
+    return it != std::end(views_) ? *it : nullptr;
+}
+
+void workspace::add(view* v)
+{
+    views_.insert(std::begin(views_), v);
+}
+
+void workspace::remove(view* v)
+{
+    views_.erase(std::remove(std::begin(views_), std::end(views_), v),
+                 std::end(views_));
+}
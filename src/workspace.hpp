@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+class output;
+class view;
+
+/// a group of views on one output, only the output's active workspace is
+/// rendered, hit tested and sent frame callbacks. its views show on every
+/// output they overlap.
+class workspace
+{
+private:
+    output*     output_;
+    std::size_t index_;
+
+    // topmost first, like server::views()
+    std::vector<view*> views_;
+
+public:
+    workspace(output* out, std::size_t index);
+
+    output* get_output() const
+    {
+        return output_;
+    }
+
+    std::size_t index() const
+    {
+        return index_;
+    }
+
+    const std::vector<view*>& views() const
+    {
+        return views_;
+    }
+
+    bool active() const;
+
+    /// the mapped view on top, if any
+    view* topmost_mapped() const;
+
+    void add(view* v);
+    void remove(view* v);
+};
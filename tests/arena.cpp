@@ -0,0 +1,59 @@
+#include <catch2/catch.hpp>
+
+#include <memory_resource>
+#include <string>
+#include <vector>
+
+#include "arena.hpp"
+
+TEST_CASE("allocations that fit come out of the buffer", "[arena]")
+{
+    scratch_arena arena{4096};
+
+    std::pmr::vector<int> numbers{arena.resource()};
+    numbers.reserve(64);
+
+    for (int i = 0; i < 64; ++i)
+    {
+        numbers.push_back(i);
+    }
+
+    std::pmr::string text{"long enough to skip the small string buffer",
+                          arena.resource()};
+
+    CHECK(numbers.back() == 63);
+    CHECK(text.size() > 16);
+    CHECK(arena.spills() == 0);
+}
+
+TEST_CASE("reset hands the same memory out again", "[arena]")
+{
+    scratch_arena arena{1024};
+
+    auto* first = arena.resource()->allocate(256, alignof(std::max_align_t));
+    arena.reset();
+    auto* again = arena.resource()->allocate(256, alignof(std::max_align_t));
+
+    CHECK(first == again);
+    CHECK(arena.spills() == 0);
+}
+
+TEST_CASE("what doesn't fit spills and is counted", "[arena]")
+{
+    scratch_arena arena{1024};
+
+    auto* big = arena.resource()->allocate(4096, alignof(std::max_align_t));
+    REQUIRE(big);
+    CHECK(arena.spills() == 1);
+
+    // spills are returned by reset as well, the count stays
+    arena.reset();
+    CHECK(arena.spills() == 1);
+
+    for (int i = 0; i < 8; ++i)
+    {
+        CHECK(arena.resource()->allocate(256, alignof(std::max_align_t)));
+    }
+
+    CHECK(arena.spills() > 1);
+}
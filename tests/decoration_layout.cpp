@@ -0,0 +1,65 @@
+#include <catch2/catch.hpp>
+
+#include "decoration_atlas.hpp"
+
+namespace
+{
+bool same(const wlr_box& a, const wlr_box& b)
+{
+    return a.x == b.x && a.y == b.y && a.width == b.width &&
+           a.height == b.height;
+}
+} // namespace
+
+TEST_CASE("the decoration wraps the content", "[decoration]")
+{
+    constexpr int border = decoration_atlas::border;
+    constexpr int th     = decoration_atlas::title_height;
+
+    auto layout = decoration_layout::around({100, 200, 300, 150});
+
+    CHECK(same(layout.bounds,
+               {100 - border, 200 - th - border, 300 + 2 * border,
+                150 + th + 2 * border}));
+    CHECK(same(layout.title, {100, 200 - th, 300, th}));
+
+    // the close button sits inside the title bar at its right end
+    wlr_box inside;
+    REQUIRE(wlr_box_intersection(&inside, &layout.close, &layout.title));
+    CHECK(same(inside, layout.close));
+    CHECK(layout.close.x + layout.close.width < 400);
+    CHECK(layout.text.x + layout.text.width <= layout.close.x);
+}
+
+TEST_CASE("text space shrinks to nothing on narrow views", "[decoration]")
+{
+    auto layout = decoration_layout::around({0, 0, 10, 10});
+
+    CHECK(layout.text.width == 0);
+}
+
+TEST_CASE("points map to the part under them", "[decoration]")
+{
+    auto layout = decoration_layout::around({100, 200, 300, 150});
+
+    auto& close = layout.close;
+    CHECK(layout.part_at(close.x + 1, close.y + 1) == decoration_part::close);
+    CHECK(layout.part_at(150, 190) == decoration_part::title);
+
+    SECTION("every side has a border")
+    {
+        CHECK(layout.part_at(99, 250) == decoration_part::border);
+        CHECK(layout.part_at(401, 250) == decoration_part::border);
+        CHECK(layout.part_at(200, 181) == decoration_part::border);
+        CHECK(layout.part_at(200, 351) == decoration_part::border);
+    }
+
+    SECTION("the content and the outside are no part of it")
+    {
+        CHECK(layout.part_at(200, 250) == decoration_part::none);
+        CHECK(layout.part_at(97, 250) == decoration_part::none);
+        CHECK(layout.part_at(402, 250) == decoration_part::none);
+        CHECK(layout.part_at(200, 179) == decoration_part::none);
+        CHECK(layout.part_at(200, 352) == decoration_part::none);
+    }
+}
@@ -0,0 +1,139 @@
+#include <catch2/catch.hpp>
+
+#include <cstdarg>
+#include <optional>
+#include <string>
+#include <thread>
+
+#include <unistd.h>
+
+#include "logger.hpp"
+
+namespace
+{
+void log_line(async_logger&      logger,
+              wlr_log_importance importance,
+              const char*        fmt,
+              ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    logger.log(importance, fmt, args);
+    va_end(args);
+}
+
+std::string read_all(int fd)
+{
+    std::string out;
+    char        buf[4096];
+    ssize_t     n;
+
+    while ((n = read(fd, buf, sizeof(buf))) > 0)
+    {
+        out.append(buf, static_cast<std::size_t>(n));
+    }
+
+    return out;
+}
+
+std::size_t count(const std::string& haystack, const std::string& needle)
+{
+    std::size_t n   = 0;
+    std::size_t pos = 0;
+
+    while ((pos = haystack.find(needle, pos)) != std::string::npos)
+    {
+        ++n;
+        pos += needle.size();
+    }
+
+    return n;
+}
+} // namespace
+
+TEST_CASE("messages are written in order with their level", "[logger]")
+{
+    int fds[2];
+    REQUIRE(pipe(fds) == 0);
+
+    {
+        async_logger logger{WLR_INFO, fds[1]};
+
+        REQUIRE(async_logger::instance() == &logger);
+
+        log_line(logger, WLR_ERROR, "first %d", 1);
+        log_line(logger, WLR_DEBUG, "filtered");
+        log_line(logger, WLR_INFO, "second %s", "two");
+    }
+
+    REQUIRE(async_logger::instance() == nullptr);
+
+    close(fds[1]);
+    auto out = read_all(fds[0]);
+    close(fds[0]);
+
+    auto first  = out.find("[ERROR] first 1\n");
+    auto second = out.find("[INFO] second two\n");
+
+    REQUIRE(first != std::string::npos);
+    REQUIRE(second != std::string::npos);
+    CHECK(first < second);
+    CHECK(out.find("filtered") == std::string::npos);
+}
+
+TEST_CASE("set_level changes what gets through", "[logger]")
+{
+    int fds[2];
+    REQUIRE(pipe(fds) == 0);
+
+    {
+        async_logger logger{WLR_ERROR, fds[1]};
+
+        log_line(logger, WLR_DEBUG, "hidden");
+        logger.set_level(WLR_DEBUG);
+        CHECK(logger.level() == WLR_DEBUG);
+        log_line(logger, WLR_DEBUG, "shown");
+    }
+
+    close(fds[1]);
+    auto out = read_all(fds[0]);
+    close(fds[0]);
+
+    CHECK(out.find("hidden") == std::string::npos);
+    CHECK(out.find("[DEBUG] shown\n") != std::string::npos);
+}
+
+TEST_CASE("a full ring drops and counts instead of blocking", "[logger]")
+{
+    int fds[2];
+    REQUIRE(pipe(fds) == 0);
+
+    // nobody reads the pipe yet, so the writer thread blocks once the pipe
+    // is full and the ring has to fill up behind it
+    constexpr std::size_t total = async_logger::capacity * 4;
+    std::string           padding(400, 'x');
+
+    std::optional<async_logger> logger;
+    logger.emplace(WLR_INFO, fds[1]);
+
+    for (std::size_t i = 0; i < total; ++i)
+    {
+        log_line(*logger, WLR_INFO, "%s", padding.c_str());
+    }
+
+    auto dropped = logger->dropped();
+    CHECK(dropped > 0);
+    CHECK(dropped < total);
+
+    std::string out;
+    std::thread reader{[&] { out = read_all(fds[0]); }};
+
+    // the destructor flushes whatever is still queued
+    logger.reset();
+
+    close(fds[1]);
+    reader.join();
+    close(fds[0]);
+
+    CHECK(count(out, "[INFO] " + padding) + dropped == total);
+}
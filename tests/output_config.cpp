@@ -0,0 +1,164 @@
+#include <catch2/catch.hpp>
+
+#include <vector>
+
+#include "output_config.hpp"
+
+namespace
+{
+/// an output with just a mode list, enough for select_output_mode
+struct fake_output
+{
+    wlr_output                   output{};
+    std::vector<wlr_output_mode> modes;
+
+    fake_output(std::vector<wlr_output_mode> list) : modes{std::move(list)}
+    {
+        wl_list_init(&output.modes);
+
+        for (auto&& mode : modes)
+        {
+            wl_list_insert(output.modes.prev, &mode.link);
+        }
+    }
+};
+
+wlr_output_mode mode(int32_t width,
+                     int32_t height,
+                     int32_t refresh,
+                     bool    preferred = false)
+{
+    wlr_output_mode m{};
+    m.width     = width;
+    m.height    = height;
+    m.refresh   = refresh;
+    m.preferred = preferred;
+
+    return m;
+}
+
+output_config parse(const char* entry, bool& ok)
+{
+    output_config config = default_output_config();
+    ok                   = parse_output_config(entry, config);
+
+    return config;
+}
+} // namespace
+
+TEST_CASE("a full entry sets every field", "[output_config]")
+{
+    bool ok;
+    auto config =
+        parse("DP-1 mode=2560x1440@143.912 scale=1.5 pos=100,-20", ok);
+
+    REQUIRE(ok);
+    CHECK(config.name == "DP-1");
+    CHECK(config.enabled);
+    CHECK(config.width == 2560);
+    CHECK(config.height == 1440);
+    CHECK(config.refresh == 143912);
+    CHECK(config.scale == Approx(1.5f));
+    CHECK(config.positioned);
+    CHECK(config.x == 100);
+    CHECK(config.y == -20);
+}
+
+TEST_CASE("fields left out keep their defaults", "[output_config]")
+{
+    bool ok;
+    auto config = parse("HDMI-A-1  off", ok);
+
+    REQUIRE(ok);
+    CHECK(config.name == "HDMI-A-1");
+    CHECK_FALSE(config.enabled);
+    CHECK(config.policy == mode_policy::highest_refresh);
+    CHECK(config.width == 0);
+    CHECK(config.scale == 0.f);
+    CHECK_FALSE(config.positioned);
+}
+
+TEST_CASE("mode policies are parsed", "[output_config]")
+{
+    bool ok;
+
+    CHECK(parse("* mode=preferred", ok).policy == mode_policy::preferred);
+    CHECK(ok);
+    CHECK(parse("* mode=highest", ok).policy == mode_policy::highest_refresh);
+    CHECK(ok);
+    CHECK(parse("* mode=1280x720", ok).refresh == 0);
+    CHECK(ok);
+}
+
+TEST_CASE("malformed entries are rejected", "[output_config]")
+{
+    bool ok;
+
+    for (auto* entry : {"",
+                        "DP-1 mode=fast",
+                        "DP-1 mode=1920x",
+                        "DP-1 scale=0",
+                        "DP-1 scale=-1",
+                        "DP-1 pos=10",
+                        "DP-1 rotate=90"})
+    {
+        INFO(entry);
+        parse(entry, ok);
+        CHECK_FALSE(ok);
+    }
+}
+
+TEST_CASE("modes are picked by policy and request", "[output_config]")
+{
+    fake_output out{{mode(1920, 1080, 60000, true),
+                     mode(1920, 1080, 144000),
+                     mode(2560, 1440, 60000),
+                     mode(1280, 720, 75000)}};
+
+    auto& modes  = out.modes;
+    auto  config = default_output_config();
+
+    SECTION("highest refresh at the preferred resolution by default")
+    {
+        CHECK(select_output_mode(&out.output, config) == &modes[1]);
+    }
+
+    SECTION("exactly the preferred mode if asked to")
+    {
+        config.policy = mode_policy::preferred;
+        CHECK(select_output_mode(&out.output, config) == &modes[0]);
+    }
+
+    SECTION("an explicit resolution")
+    {
+        config.width  = 2560;
+        config.height = 1440;
+        CHECK(select_output_mode(&out.output, config) == &modes[2]);
+    }
+
+    SECTION("the nearest refresh to the one requested")
+    {
+        config.width   = 1920;
+        config.height  = 1080;
+        config.refresh = 120000;
+        CHECK(select_output_mode(&out.output, config) == &modes[1]);
+
+        config.refresh = 75000;
+        CHECK(select_output_mode(&out.output, config) == &modes[0]);
+    }
+
+    SECTION("an unknown resolution falls back to the policy")
+    {
+        config.width  = 800;
+        config.height = 600;
+        CHECK(select_output_mode(&out.output, config) == &modes[1]);
+    }
+}
+
+TEST_CASE("outputs without modes get none", "[output_config]")
+{
+    fake_output out{{}};
+
+    CHECK(select_output_mode(&out.output, default_output_config()) ==
+          nullptr);
+}
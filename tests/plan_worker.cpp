@@ -0,0 +1,82 @@
+#include <catch2/catch.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+
+#include "plan_worker.hpp"
+
+namespace
+{
+// build_plan only passes surfaces through, never dereferences them
+wlr_surface* fake_surface(std::uintptr_t id)
+{
+    return reinterpret_cast<wlr_surface*>(id * 16);
+}
+
+plan_snapshot snapshot_of(int views)
+{
+    plan_snapshot snapshot{};
+    snapshot.placed       = true;
+    snapshot.target.box   = {0, 0, 100, 100};
+    snapshot.target.scale = 1;
+    snapshot.size_class   = 1;
+
+    float identity[9] = {1, 0, 0, 0, 1, 0, 0, 0, 1};
+    std::copy(std::begin(identity),
+              std::end(identity),
+              std::begin(snapshot.target.transform_matrix));
+
+    for (int i = 0; i < views; ++i)
+    {
+        plan_view v{};
+        v.x = i * 10;
+        v.surfaces.push_back({fake_surface(i + 1),
+                              {0, 0, 20, 10},
+                              WL_OUTPUT_TRANSFORM_NORMAL,
+                              {0, 0, 0, 0}});
+        v.usages.push_back(nullptr);
+
+        snapshot.views.push_back(v);
+    }
+
+    snapshot.count = snapshot.views.size();
+
+    return snapshot;
+}
+} // namespace
+
+TEST_CASE("the worker builds what build_plan would", "[plan_worker]")
+{
+    plan_worker worker;
+
+    std::vector<render_entry> plan;
+    std::vector<plan_span>    spans;
+
+    CHECK_FALSE(worker.busy());
+    CHECK_FALSE(worker.collect());
+
+    // again and again, each handoff has to come back whole
+    for (int round = 1; round <= 50; ++round)
+    {
+        auto snapshot = snapshot_of(round % 12);
+
+        worker.submit(snapshot, plan, spans);
+        CHECK(worker.busy());
+        REQUIRE(worker.collect());
+        CHECK_FALSE(worker.busy());
+
+        std::vector<render_entry> expected;
+        std::vector<plan_span>    expected_spans;
+        build_plan(snapshot, expected, expected_spans);
+
+        REQUIRE(plan.size() == expected.size());
+        REQUIRE(spans.size() == expected_spans.size());
+
+        for (std::size_t i = 0; i < plan.size(); ++i)
+        {
+            CHECK(plan[i].surface == expected[i].surface);
+            CHECK(plan[i].box.x == expected[i].box.x);
+        }
+    }
+}
@@ -0,0 +1,213 @@
+#include <catch2/catch.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <string>
+
+#include "render_plan.hpp"
+
+namespace
+{
+// build_plan only passes surfaces and usages through, never dereferences them
+template <typename T>
+T* fake(std::uintptr_t id)
+{
+    return reinterpret_cast<T*>(id * 16);
+}
+
+bool same(const wlr_box& a, const wlr_box& b)
+{
+    return a.x == b.x && a.y == b.y && a.width == b.width &&
+           a.height == b.height;
+}
+
+plan_snapshot snapshot_of(const wlr_box& box, float scale)
+{
+    plan_snapshot snapshot{};
+    snapshot.placed       = true;
+    snapshot.target.box   = box;
+    snapshot.target.scale = scale;
+    snapshot.size_class   = decoration_atlas::size_class(scale);
+
+    float identity[9] = {1, 0, 0, 0, 1, 0, 0, 0, 1};
+    std::copy(std::begin(identity),
+              std::end(identity),
+              std::begin(snapshot.target.transform_matrix));
+
+    return snapshot;
+}
+
+/// a view of one surface the size of the view, at x, y
+void add_view(plan_snapshot& snapshot, int x, int y, std::uintptr_t id)
+{
+    plan_view v{};
+    v.x = x;
+    v.y = y;
+    v.surfaces.push_back({fake<wlr_surface>(id),
+                          {0, 0, 20, 10},
+                          WL_OUTPUT_TRANSFORM_NORMAL,
+                          {0, 0, 0, 0}});
+    v.usages.push_back(fake<client_usage>(id));
+
+    snapshot.views.push_back(v);
+    snapshot.count = snapshot.views.size();
+}
+} // namespace
+
+TEST_CASE("views off the output are culled", "[render_plan]")
+{
+    auto snapshot = snapshot_of({0, 0, 100, 100}, 1);
+    add_view(snapshot, 10, 10, 1);
+    add_view(snapshot, 200, 10, 2);
+    add_view(snapshot, 95, 95, 3);
+
+    std::vector<render_entry> plan;
+    std::vector<plan_span>    spans;
+    build_plan(snapshot, plan, spans);
+
+    REQUIRE(plan.size() == 2);
+    CHECK(plan[0].surface == fake<wlr_surface>(1));
+    CHECK(plan[0].usage == fake<client_usage>(1));
+    CHECK(plan[0].texture == nullptr);
+    CHECK(same(plan[0].box, {10, 10, 20, 10}));
+
+    // partly visible surfaces are drawn whole, the output clips them
+    CHECK(plan[1].surface == fake<wlr_surface>(3));
+    CHECK(same(plan[1].box, {95, 95, 20, 10}));
+}
+
+TEST_CASE("boxes are relative to the output and scaled", "[render_plan]")
+{
+    auto snapshot = snapshot_of({1000, 0, 100, 100}, 2);
+    add_view(snapshot, 1010, 20, 1);
+
+    std::vector<render_entry> plan;
+    std::vector<plan_span>    spans;
+    build_plan(snapshot, plan, spans);
+
+    REQUIRE(plan.size() == 1);
+    CHECK(same(plan[0].box, {20, 40, 40, 20}));
+}
+
+TEST_CASE("the plan is replaced, not appended to", "[render_plan]")
+{
+    auto snapshot = snapshot_of({0, 0, 100, 100}, 1);
+    add_view(snapshot, 0, 0, 1);
+    add_view(snapshot, 10, 0, 2);
+
+    std::vector<render_entry> plan;
+    std::vector<plan_span>    spans;
+    build_plan(snapshot, plan, spans);
+    REQUIRE(plan.size() == 2);
+
+    SECTION("views past count are left out")
+    {
+        snapshot.count = 1;
+        build_plan(snapshot, plan, spans);
+
+        REQUIRE(plan.size() == 1);
+        CHECK(plan[0].surface == fake<wlr_surface>(1));
+    }
+
+    SECTION("outputs outside the layout get nothing")
+    {
+        snapshot.placed = false;
+        build_plan(snapshot, plan, spans);
+
+        CHECK(plan.empty());
+        CHECK(spans.empty());
+    }
+}
+
+TEST_CASE("each view's draws are spanned", "[render_plan]")
+{
+    auto snapshot = snapshot_of({0, 0, 100, 100}, 1);
+    add_view(snapshot, 0, 0, 1);
+    add_view(snapshot, 200, 0, 2);
+    add_view(snapshot, 10, 0, 3);
+
+    std::vector<render_entry> plan;
+    std::vector<plan_span>    spans;
+    build_plan(snapshot, plan, spans);
+
+    REQUIRE(spans.size() == 3);
+    CHECK(spans[0].begin == 0);
+    CHECK(spans[0].count == 1);
+
+    // culled views keep an empty span so spans line up with views
+    CHECK(spans[1].begin == 1);
+    CHECK(spans[1].count == 0);
+    CHECK(spans[2].begin == 1);
+    CHECK(spans[2].count == 1);
+
+    SECTION("and emit_view redraws just one of them")
+    {
+        std::vector<render_entry> patch;
+        snapshot.views[2].x = 30;
+        emit_view(snapshot, snapshot.views[2], patch);
+
+        REQUIRE(patch.size() == 1);
+        CHECK(patch[0].surface == fake<wlr_surface>(3));
+        CHECK(same(patch[0].box, {30, 0, 20, 10}));
+    }
+}
+
+TEST_CASE("decorations are drawn below their view", "[render_plan]")
+{
+    auto snapshot = snapshot_of({0, 0, 200, 200}, 1);
+    add_view(snapshot, 50, 50, 1);
+
+    auto& v      = snapshot.views[0];
+    v.decorated  = true;
+    v.decoration = decoration_layout::around({50, 50, 20, 10});
+    v.state      = decoration_state::focused;
+
+    wlr_texture               atlas{};
+    std::vector<render_entry> plan;
+    std::vector<plan_span>    spans;
+
+    SECTION("from the atlas")
+    {
+        snapshot.atlas = &atlas;
+        build_plan(snapshot, plan, spans);
+
+        // borders, title bar and close button, then the surface
+        REQUIRE(plan.size() == v.decoration.borders.size() + 3);
+
+        for (std::size_t i = 0; i + 1 < plan.size(); ++i)
+        {
+            CHECK(plan[i].surface == nullptr);
+            CHECK(plan[i].get_texture() == &atlas);
+        }
+
+        CHECK(plan.back().surface == fake<wlr_surface>(1));
+    }
+
+    SECTION("titles as one atlas quad per glyph that fits")
+    {
+        snapshot.atlas = &atlas;
+        v.decoration   = decoration_layout::around({50, 50, 120, 10});
+        v.title        = "a b";
+        build_plan(snapshot, plan, spans);
+
+        // spaces take room but draw nothing
+        REQUIRE(plan.size() == v.decoration.borders.size() + 3 + 2);
+        CHECK(plan[plan.size() - 2].get_texture() == &atlas);
+
+        v.title = std::string(1000, 'x');
+        build_plan(snapshot, plan, spans);
+
+        auto glyphs = plan.size() - v.decoration.borders.size() - 3;
+        CHECK(static_cast<int>(glyphs) ==
+              v.decoration.text.width / decoration_atlas::glyph_width);
+    }
+
+    SECTION("not at all without an atlas")
+    {
+        build_plan(snapshot, plan, spans);
+
+        REQUIRE(plan.size() == 1);
+        CHECK(plan[0].surface == fake<wlr_surface>(1));
+    }
+}
@@ -0,0 +1,50 @@
+#!/bin/sh
+# run trinkster-stress against a compositor on the headless backend
+# usage: stress-headless.sh <trinkster> <trinkster-stress> [stress args...]
+
+set -e
+
+trinkster=$1
+stress=$2
+shift 2
+
+runtime_dir=$(mktemp -d)
+trap 'kill $pid 2>/dev/null; rm -rf "$runtime_dir"' EXIT
+
+export XDG_RUNTIME_DIR=$runtime_dir
+export WLR_BACKENDS=headless
+export WLR_HEADLESS_OUTPUTS=${WLR_HEADLESS_OUTPUTS:-1}
+export WLR_LIBINPUT_NO_DEVICES=1
+export TRINKSTER_LOG_LEVEL=${TRINKSTER_LOG_LEVEL:-error}
+
+"$trinkster" &
+pid=$!
+
+# the ipc socket is named after the display socket the compositor got, wait
+# for it to show up and give up early if the compositor dies on the way
+sock=
+for _ in $(seq 50); do
+    for candidate in "$runtime_dir"/trinkster.*.sock; do
+        [ -S "$candidate" ] && sock=$candidate
+    done
+    [ -n "$sock" ] && break
+
+    if ! kill -0 $pid 2>/dev/null; then
+        wait $pid || status=$?
+        echo "trinkster exited early with status ${status:-0}" >&2
+        exit 1
+    fi
+
+    sleep 0.1
+done
+
+if [ -z "$sock" ]; then
+    echo "trinkster didn't open its sockets in time" >&2
+    exit 1
+fi
+
+display=${sock##*/trinkster.}
+export WAYLAND_DISPLAY=${display%.sock}
+export TRINKSTER_SOCK=$sock
+
+"$stress" "$@"
@@ -0,0 +1,750 @@
+// many-client stress harness for trinkster
+//
+// opens a number of connections, each with a number of xdg toplevels that
+// commit shm buffers at a fixed rate (or as fast as frame callbacks allow)
+// and reports commit throughput, frame callback latency and what the
+// compositor reports about itself over its IPC socket.
+//
+// with -a it also fails unless a compositor built with the alloc_counter
+// option made no C++ allocations, through global operator new, once past
+// the warmup, while frames keep coming and the pointer is moved over IPC.
+// malloc from wlroots, pixman and libwayland isn't counted.
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <wayland-client.h>
+
+#include "xdg-shell-client-protocol.h"
+
+namespace
+{
+struct options
+{
+    int  connections  = 10;
+    int  windows      = 10;
+    int  rate         = 60;
+    int  duration     = 10;
+    int  width        = 64;
+    int  height       = 64;
+    int  motions      = 0;
+    bool check_allocs = false;
+};
+
+// startup allocations aren't interesting to the allocation check
+constexpr uint64_t warmup_ns = 2000000000;
+
+uint64_t now_ns()
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+struct connection;
+
+struct window
+{
+    connection*   conn;
+    wl_surface*   surface;
+    xdg_surface*  xdg;
+    xdg_toplevel* toplevel;
+    wl_buffer*    buffers[2];
+    int           current;
+    bool          configured;
+    bool          waiting_frame;
+    uint64_t      commit_ns;
+    uint64_t      next_commit_ns;
+};
+
+struct connection
+{
+    wl_display*    display;
+    wl_registry*   registry;
+    wl_compositor* compositor;
+    wl_shm*        shm;
+    xdg_wm_base*   wm_base;
+    wl_shm_pool*   pool;
+    void*          data;
+    std::size_t    size;
+
+    std::vector<std::unique_ptr<window>> windows;
+};
+
+struct totals
+{
+    uint64_t              commits;
+    uint64_t              frames;
+    std::vector<uint64_t> latencies_ns;
+};
+
+options opts;
+totals  stats;
+
+void handle_global(void*        data,
+                   wl_registry* registry,
+                   uint32_t     name,
+                   const char*  interface,
+                   uint32_t     version)
+{
+    (void) version;
+    auto* conn = static_cast<connection*>(data);
+
+    if (std::strcmp(interface, wl_compositor_interface.name) == 0)
+    {
+        conn->compositor = static_cast<wl_compositor*>(
+            wl_registry_bind(registry, name, &wl_compositor_interface, 4));
+    }
+    else if (std::strcmp(interface, wl_shm_interface.name) == 0)
+    {
+        conn->shm = static_cast<wl_shm*>(
+            wl_registry_bind(registry, name, &wl_shm_interface, 1));
+    }
+    else if (std::strcmp(interface, xdg_wm_base_interface.name) == 0)
+    {
+        conn->wm_base = static_cast<xdg_wm_base*>(
+            wl_registry_bind(registry, name, &xdg_wm_base_interface, 1));
+    }
+}
+
+void handle_global_remove(void* data, wl_registry* registry, uint32_t name)
+{
+    (void) data;
+    (void) registry;
+    (void) name;
+}
+
+const wl_registry_listener registry_listener{
+    handle_global,
+    handle_global_remove,
+};
+
+void handle_ping(void* data, xdg_wm_base* wm_base, uint32_t serial)
+{
+    (void) data;
+    xdg_wm_base_pong(wm_base, serial);
+}
+
+const xdg_wm_base_listener wm_base_listener{
+    handle_ping,
+};
+
+void commit(window& win);
+
+void handle_frame_done(void* data, wl_callback* callback, uint32_t time)
+{
+    (void) time;
+    auto* win = static_cast<window*>(data);
+
+    wl_callback_destroy(callback);
+
+    ++stats.frames;
+    stats.latencies_ns.push_back(now_ns() - win->commit_ns);
+    win->waiting_frame = false;
+
+    if (opts.rate == 0)
+    {
+        commit(*win);
+    }
+}
+
+const wl_callback_listener frame_listener{
+    handle_frame_done,
+};
+
+void commit(window& win)
+{
+    win.current = 1 - win.current;
+
+    wl_surface_attach(win.surface, win.buffers[win.current], 0, 0);
+    wl_surface_damage_buffer(win.surface, 0, 0, opts.width, opts.height);
+
+    if (!win.waiting_frame)
+    {
+        auto* callback = wl_surface_frame(win.surface);
+        wl_callback_add_listener(callback, &frame_listener, &win);
+        win.waiting_frame = true;
+        win.commit_ns     = now_ns();
+    }
+
+    wl_surface_commit(win.surface);
+    ++stats.commits;
+}
+
+void handle_xdg_configure(void* data, xdg_surface* xdg, uint32_t serial)
+{
+    auto* win = static_cast<window*>(data);
+
+    xdg_surface_ack_configure(xdg, serial);
+
+    if (!win->configured)
+    {
+        win->configured = true;
+        commit(*win);
+    }
+}
+
+const xdg_surface_listener xdg_listener{
+    handle_xdg_configure,
+};
+
+void handle_toplevel_configure(void*          data,
+                               xdg_toplevel*  toplevel,
+                               int32_t        width,
+                               int32_t        height,
+                               wl_array*      states)
+{
+    (void) data;
+    (void) toplevel;
+    (void) width;
+    (void) height;
+    (void) states;
+}
+
+void handle_toplevel_close(void* data, xdg_toplevel* toplevel)
+{
+    (void) data;
+    (void) toplevel;
+}
+
+const xdg_toplevel_listener toplevel_listener{
+    handle_toplevel_configure,
+    handle_toplevel_close,
+};
+
+bool setup_connection(connection& conn, int index)
+{
+    conn.display = wl_display_connect(nullptr);
+    if (!conn.display)
+    {
+        std::fprintf(stderr, "failed to connect to the compositor\n");
+        return false;
+    }
+
+    conn.registry = wl_display_get_registry(conn.display);
+    wl_registry_add_listener(conn.registry, &registry_listener, &conn);
+    wl_display_roundtrip(conn.display);
+
+    if (!conn.compositor || !conn.shm || !conn.wm_base)
+    {
+        std::fprintf(stderr, "compositor lacks required globals\n");
+        return false;
+    }
+
+    xdg_wm_base_add_listener(conn.wm_base, &wm_base_listener, &conn);
+
+    // two buffers per window, all in one pool
+    int         stride = opts.width * 4;
+    std::size_t buffer_size =
+        static_cast<std::size_t>(stride) * opts.height;
+    conn.size = buffer_size * 2 * opts.windows;
+
+    int fd = memfd_create("trinkster-stress", MFD_CLOEXEC);
+    if (fd < 0 || ftruncate(fd, static_cast<off_t>(conn.size)) < 0)
+    {
+        std::perror("memfd");
+        return false;
+    }
+
+    conn.data =
+        mmap(nullptr, conn.size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (conn.data == MAP_FAILED)
+    {
+        std::perror("mmap");
+        close(fd);
+        return false;
+    }
+
+    // a different shade per connection so it's visible on screenshots
+    auto* pixels = static_cast<uint32_t*>(conn.data);
+    std::fill(pixels,
+              pixels + conn.size / 4,
+              0xff000000 | static_cast<uint32_t>(index * 2654435761u));
+
+    conn.pool =
+        wl_shm_create_pool(conn.shm, fd, static_cast<int32_t>(conn.size));
+    close(fd);
+
+    for (int i = 0; i < opts.windows; ++i)
+    {
+        auto win  = std::make_unique<window>();
+        win->conn = &conn;
+
+        for (int b = 0; b < 2; ++b)
+        {
+            auto offset = (static_cast<std::size_t>(i) * 2 + b) * buffer_size;
+            win->buffers[b] =
+                wl_shm_pool_create_buffer(conn.pool,
+                                          static_cast<int32_t>(offset),
+                                          opts.width,
+                                          opts.height,
+                                          stride,
+                                          WL_SHM_FORMAT_ARGB8888);
+        }
+
+        win->surface  = wl_compositor_create_surface(conn.compositor);
+        win->xdg      = xdg_wm_base_get_xdg_surface(conn.wm_base, win->surface);
+        win->toplevel = xdg_surface_get_toplevel(win->xdg);
+
+        xdg_surface_add_listener(win->xdg, &xdg_listener, win.get());
+        xdg_toplevel_add_listener(
+            win->toplevel, &toplevel_listener, win.get());
+
+        std::string title = "stress " + std::to_string(index) + "/" +
+                            std::to_string(i);
+        xdg_toplevel_set_title(win->toplevel, title.c_str());
+
+        wl_surface_commit(win->surface);
+        conn.windows.push_back(std::move(win));
+    }
+
+    return true;
+}
+
+/// connect to the compositor's IPC socket, -1 if it can't be reached
+int ipc_connect()
+{
+    std::string path;
+
+    if (const char* sock = std::getenv("TRINKSTER_SOCK"))
+    {
+        path = sock;
+    }
+    else
+    {
+        const char* runtime = std::getenv("XDG_RUNTIME_DIR");
+        const char* display = std::getenv("WAYLAND_DISPLAY");
+
+        if (!runtime)
+        {
+            return -1;
+        }
+
+        path = std::string{runtime} + "/trinkster." +
+               (display ? display : "wayland-0") + ".sock";
+    }
+
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 ||
+        connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0)
+    {
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        return -1;
+    }
+
+    return fd;
+}
+
+/// send a command over an IPC connection and wait for its reply line
+std::string ipc_request(int fd, const std::string& command)
+{
+    std::string request = command + "\n";
+    if (write(fd, request.data(), request.size()) < 0)
+    {
+        return {};
+    }
+
+    std::string reply;
+    char        buf[4096];
+    ssize_t     n;
+    while (reply.find('\n') == std::string::npos &&
+           (n = read(fd, buf, sizeof(buf))) > 0)
+    {
+        reply.append(buf, static_cast<std::size_t>(n));
+    }
+
+    return reply.substr(0, reply.find('\n'));
+}
+
+/// send a single command on its own connection
+std::string ipc_query(const char* command)
+{
+    int fd = ipc_connect();
+    if (fd < 0)
+    {
+        return {};
+    }
+
+    auto reply = ipc_request(fd, command);
+    close(fd);
+
+    return reply;
+}
+
+/// pull a numeric field out of a flat JSON object
+uint64_t json_number(const std::string& json, const char* key)
+{
+    auto needle = std::string{"\""} + key + "\":";
+    auto pos    = json.find(needle);
+
+    if (pos == std::string::npos)
+    {
+        return 0;
+    }
+
+    return std::strtoull(json.c_str() + pos + needle.size(), nullptr, 10);
+}
+
+uint64_t rss_kb(uint64_t pid)
+{
+    std::string path = "/proc/" + std::to_string(pid) + "/status";
+    FILE*       file = std::fopen(path.c_str(), "r");
+
+    if (!file)
+    {
+        return 0;
+    }
+
+    char     line[256];
+    uint64_t rss = 0;
+    while (std::fgets(line, sizeof(line), file))
+    {
+        if (std::strncmp(line, "VmRSS:", 6) == 0)
+        {
+            rss = std::strtoull(line + 6, nullptr, 10);
+            break;
+        }
+    }
+
+    std::fclose(file);
+
+    return rss;
+}
+
+uint64_t percentile(std::vector<uint64_t>& values, double p)
+{
+    if (values.empty())
+    {
+        return 0;
+    }
+
+    auto index = static_cast<std::size_t>(p * (values.size() - 1));
+    std::nth_element(
+        std::begin(values), std::begin(values) + index, std::end(values));
+
+    return values[index];
+}
+
+void usage(const char* argv0)
+{
+    std::fprintf(stderr,
+                 "usage: %s [-c connections] [-w windows per connection] "
+                 "[-r commits/s per window, 0 follows frame callbacks] "
+                 "[-d seconds] [-s WxH] [-m pointer motions] "
+                 "[-a fail on compositor operator new calls]\n",
+                 argv0);
+}
+} // namespace
+
+int main(int argc, char** argv)
+{
+    int opt;
+    while ((opt = getopt(argc, argv, "c:w:r:d:s:m:ah")) != -1)
+    {
+        switch (opt)
+        {
+        case 'c':
+            opts.connections = std::atoi(optarg);
+            break;
+        case 'w':
+            opts.windows = std::atoi(optarg);
+            break;
+        case 'r':
+            opts.rate = std::atoi(optarg);
+            break;
+        case 'd':
+            opts.duration = std::atoi(optarg);
+            break;
+        case 's':
+            if (std::sscanf(optarg, "%dx%d", &opts.width, &opts.height) != 2)
+            {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 'm':
+            opts.motions = std::atoi(optarg);
+            break;
+        case 'a':
+            opts.check_allocs = true;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    auto     before   = ipc_query("stats");
+    uint64_t pid      = json_number(before, "pid");
+    uint64_t rss_base = pid ? rss_kb(pid) : 0;
+
+    // motions and the allocation check share one connection, a new one
+    // would be an allocation of its own.
+    int control = -1;
+    if (opts.motions || opts.check_allocs)
+    {
+        control = ipc_connect();
+        if (control < 0)
+        {
+            std::fprintf(stderr, "compositor IPC socket not reachable\n");
+            return 1;
+        }
+
+        if (opts.check_allocs &&
+            ipc_request(control, "stats").find("\"allocs\"") ==
+                std::string::npos)
+        {
+            std::fprintf(stderr,
+                         "compositor wasn't built with alloc_counter\n");
+            return 1;
+        }
+    }
+
+    std::vector<std::unique_ptr<connection>> conns;
+    for (int i = 0; i < opts.connections; ++i)
+    {
+        auto conn = std::make_unique<connection>();
+        if (!setup_connection(*conn, i))
+        {
+            return 1;
+        }
+        conns.push_back(std::move(conn));
+    }
+
+    std::fprintf(stderr,
+                 "%d connections with %d windows each, %d commits/s\n",
+                 opts.connections,
+                 opts.windows,
+                 opts.rate);
+
+    stats.latencies_ns.reserve(1 << 20);
+
+    uint64_t start    = now_ns();
+    uint64_t end = start + static_cast<uint64_t>(opts.duration) * 1000000000;
+    uint64_t interval = opts.rate ? 1000000000 / opts.rate : 0;
+
+    uint64_t motion_interval =
+        opts.motions ? (end - start) / static_cast<uint64_t>(opts.motions) : 0;
+    uint64_t next_motion = start;
+    int      motions     = 0;
+
+    uint64_t    checked_ns = 0;
+    std::string allocs_before;
+
+    std::vector<pollfd> fds(conns.size());
+
+    for (uint64_t now = start; now < end; now = now_ns())
+    {
+        if (opts.check_allocs && !checked_ns && now >= start + warmup_ns)
+        {
+            allocs_before = ipc_request(control, "stats");
+            checked_ns    = now;
+        }
+
+        if (motion_interval && motions < opts.motions && now >= next_motion)
+        {
+            // sweep across and down the layout, the compositor clamps
+            auto x = (motions * 37) % 2048;
+            auto y = (motions * 23) % 1536;
+
+            ipc_request(control,
+                        "motion " + std::to_string(x) + " " +
+                            std::to_string(y));
+            ++motions;
+            next_motion += motion_interval;
+        }
+
+        if (interval)
+        {
+            for (auto&& conn : conns)
+            {
+                for (auto&& win : conn->windows)
+                {
+                    if (win->configured && now >= win->next_commit_ns)
+                    {
+                        commit(*win);
+                        win->next_commit_ns = now + interval;
+                    }
+                }
+            }
+        }
+
+        for (std::size_t i = 0; i < conns.size(); ++i)
+        {
+            auto* display = conns[i]->display;
+
+            while (wl_display_prepare_read(display) != 0)
+            {
+                wl_display_dispatch_pending(display);
+            }
+            wl_display_flush(display);
+
+            fds[i] = {wl_display_get_fd(display), POLLIN, 0};
+        }
+
+        int timeout = interval ? 1 : 100;
+        if (poll(fds.data(), fds.size(), timeout) < 0 && errno != EINTR)
+        {
+            std::perror("poll");
+            return 1;
+        }
+
+        for (std::size_t i = 0; i < conns.size(); ++i)
+        {
+            auto* display = conns[i]->display;
+
+            if (fds[i].revents & POLLIN)
+            {
+                wl_display_read_events(display);
+            }
+            else
+            {
+                wl_display_cancel_read(display);
+            }
+
+            if (wl_display_dispatch_pending(display) < 0)
+            {
+                std::fprintf(stderr, "connection %zu lost\n", i);
+                return 1;
+            }
+        }
+    }
+
+    double seconds = (now_ns() - start) / 1e9;
+
+    std::string allocs_after;
+    if (opts.check_allocs && checked_ns)
+    {
+        allocs_after = ipc_request(control, "stats");
+    }
+
+    if (control >= 0)
+    {
+        close(control);
+    }
+
+    // let the compositor describe how it coped while everything is alive
+    auto after    = ipc_query("stats");
+    auto loop     = ipc_query("loop");
+    auto rss_end  = pid ? rss_kb(pid) : 0;
+    auto rss_diff = rss_end > rss_base ? rss_end - rss_base : 0;
+
+    int clients = opts.connections;
+    int windows = opts.connections * opts.windows;
+
+    std::printf("commits:           %lu (%.0f/s)\n",
+                static_cast<unsigned long>(stats.commits),
+                stats.commits / seconds);
+    std::printf("frame callbacks:   %lu (%.0f/s)\n",
+                static_cast<unsigned long>(stats.frames),
+                stats.frames / seconds);
+    auto& latencies = stats.latencies_ns;
+    std::printf("frame latency us:  p50 %lu p90 %lu p99 %lu max %lu\n",
+                static_cast<unsigned long>(percentile(latencies, 0.5) / 1000),
+                static_cast<unsigned long>(percentile(latencies, 0.9) / 1000),
+                static_cast<unsigned long>(percentile(latencies, 0.99) / 1000),
+                static_cast<unsigned long>(percentile(latencies, 1.0) / 1000));
+
+    if (!loop.empty())
+    {
+        auto avg = json_number(loop, "dispatch_avg_ns") / 1000;
+        auto max = json_number(loop, "dispatch_max_ns") / 1000;
+
+        std::printf("loop dispatch us:  avg %lu max %lu, %lu overruns\n",
+                    static_cast<unsigned long>(avg),
+                    static_cast<unsigned long>(max),
+                    static_cast<unsigned long>(json_number(loop, "overruns")));
+    }
+
+    if (pid)
+    {
+        auto commits =
+            json_number(after, "commits") - json_number(before, "commits");
+        auto frames =
+            json_number(after, "frames") - json_number(before, "frames");
+
+        std::printf("server commits:    %lu (%.0f/s)\n",
+                    static_cast<unsigned long>(commits),
+                    commits / seconds);
+        std::printf("server frames:     %lu (%.0f/s)\n",
+                    static_cast<unsigned long>(frames),
+                    frames / seconds);
+        std::printf("compositor rss kb: %lu -> %lu, %.1f per client, %.1f "
+                    "per window\n",
+                    static_cast<unsigned long>(rss_base),
+                    static_cast<unsigned long>(rss_end),
+                    static_cast<double>(rss_diff) / clients,
+                    static_cast<double>(rss_diff) / windows);
+    }
+    else
+    {
+        std::printf("compositor IPC socket not reachable, no server side "
+                    "numbers\n");
+    }
+
+    if (opts.motions)
+    {
+        std::printf("pointer motions:   %d\n", motions);
+    }
+
+    int status = 0;
+
+    if (opts.check_allocs)
+    {
+        if (!checked_ns)
+        {
+            std::fprintf(stderr, "run too short to get past the warmup\n");
+            status = 1;
+        }
+        else
+        {
+            auto allocs = json_number(allocs_after, "allocs") -
+                          json_number(allocs_before, "allocs");
+            auto bytes = json_number(allocs_after, "alloc_bytes") -
+                         json_number(allocs_before, "alloc_bytes");
+            auto frames = json_number(allocs_after, "frames") -
+                          json_number(allocs_before, "frames");
+
+            std::printf("steady new calls:  %lu (%lu bytes) over %lu frames\n",
+                        static_cast<unsigned long>(allocs),
+                        static_cast<unsigned long>(bytes),
+                        static_cast<unsigned long>(frames));
+
+            if (allocs != 0 || frames == 0)
+            {
+                status = 1;
+            }
+        }
+    }
+
+    for (auto&& conn : conns)
+    {
+        wl_display_disconnect(conn->display);
+        munmap(conn->data, conn->size);
+    }
+
+    return status;
+}